@@ -1,6 +1,7 @@
 from system.pybuild import *
 from sys import argv
 from shutil import copy as copyFile
+import subprocess
 
 maker = PyBuildArgMaker()
 
@@ -38,12 +39,101 @@ def target_all():
 
     elif isPosix():
         print("Linux / Linux-like Operating System detected.")
-        ret = runCommand(toSubproccessList(f"g++ {listToString(cppFiles)} -Wall -Wextra -Wpedantic -lSDL2 -o bin/reader"), False)
+        ret = runCommand(toSubproccessList(f"g++ {listToString(cppFiles)} -Wall -Wextra -Wpedantic -pthread -lSDL2 -o bin/reader"), False)
         if ret.returncode != 0:
             print("g++ failed!")
             exit(1)
 
+# builds the headless benchmark (no SDL needed) and runs it over samples/ and any paths given after the target name
+def target_bench():
+    cppFiles = [f for f in listFilesWithExt('src/','.cpp') if os.path.basename(f) != "main.cpp"]
+    cppFiles.append("tools/bench.cpp")
+    if not exists("bin/"):
+        os.mkdir("bin/")
+
+    output = "bin/bench.exe" if isWindows() else "bin/bench"
+    extraFlags = "-lpsapi" if isWindows() else "-pthread"
+    ret = runCommand(toSubproccessList(f"g++ {listToString(cppFiles)} -O2 -Wall -Wextra -Wpedantic {extraFlags} -o {output}"), isWindows())
+    if ret.returncode != 0:
+        print("g++ failed!")
+        exit(1)
+
+    ret = subprocess.run([output, "samples/"] + argv[2:])
+    exit(ret.returncode)
+
+# sources of the decoder without SDL (libgifdecode)
+decoderFiles = ["src/gif.cpp", "src/lzw.cpp", "src/mapfile.cpp", "src/arena.cpp", "src/render.cpp", "src/gifdecode.cpp"]
+
+# builds libgifdecode, the decoder without SDL, as a static and a shared library in bin/
+def target_lib():
+    if not exists("bin/obj/"):
+        os.makedirs("bin/obj/")
+
+    objFiles = []
+    for cppFile in decoderFiles:
+        objFile = os.path.join("bin/obj/", os.path.basename(cppFile).replace(".cpp", ".o"))
+        ret = runCommand(toSubproccessList(f"g++ -c {cppFile} -O2 -fPIC -Wall -Wextra -Wpedantic -o {objFile}"), isWindows())
+        if ret.returncode != 0:
+            print("g++ failed!")
+            exit(1)
+        objFiles.append(objFile)
+
+    ret = runCommand(toSubproccessList(f"ar rcs bin/libgifdecode.a {listToString(objFiles)}"), isWindows())
+    if ret.returncode != 0:
+        print("ar failed!")
+        exit(1)
+
+    sharedLib = "bin/gifdecode.dll" if isWindows() else "bin/libgifdecode.so"
+    ret = runCommand(toSubproccessList(f"g++ -shared {listToString(objFiles)} -pthread -o {sharedLib}"), isWindows())
+    if ret.returncode != 0:
+        print("g++ failed!")
+        exit(1)
+
+# builds the headless batch transcoder (no SDL needed)
+def target_batch():
+    if not exists("bin/"):
+        os.mkdir("bin/")
+
+    output = "bin/batch.exe" if isWindows() else "bin/batch"
+    ret = runCommand(toSubproccessList(f"g++ {listToString(decoderFiles)} tools/batch.cpp -O2 -Wall -Wextra -Wpedantic -pthread -o {output}"), isWindows())
+    if ret.returncode != 0:
+        print("g++ failed!")
+        exit(1)
+
+# sources of the encoder and the optimize pass, on top of the decoder
+encoderFiles = ["src/lzwencode.cpp", "src/gifwrite.cpp", "src/optimize.cpp"]
+
+# builds the GIF re-encoder (no SDL needed)
+def target_optimize():
+    if not exists("bin/"):
+        os.mkdir("bin/")
+
+    output = "bin/optimize.exe" if isWindows() else "bin/optimize"
+    ret = runCommand(toSubproccessList(f"g++ {listToString(decoderFiles + encoderFiles)} tools/optimize.cpp -O2 -Wall -Wextra -Wpedantic -pthread -o {output}"), isWindows())
+    if ret.returncode != 0:
+        print("g++ failed!")
+        exit(1)
+
+# builds the regression tests (no SDL needed) and runs them
+def target_test():
+    if not exists("bin/"):
+        os.mkdir("bin/")
+
+    output = "bin/tests.exe" if isWindows() else "bin/tests"
+    ret = runCommand(toSubproccessList(f"g++ {listToString(decoderFiles + encoderFiles)} src/player.cpp src/wall.cpp tests/tests.cpp -O2 -Wall -Wextra -Wpedantic -pthread -o {output}"), isWindows())
+    if ret.returncode != 0:
+        print("g++ failed!")
+        exit(1)
+
+    ret = subprocess.run([output])
+    exit(ret.returncode)
+
 maker.addTarget("all",target_all)
+maker.addTarget("bench",target_bench)
+maker.addTarget("lib",target_lib)
+maker.addTarget("batch",target_batch)
+maker.addTarget("optimize",target_optimize)
+maker.addTarget("test",target_test)
 
 
 if __name__ == "__main__":
@@ -0,0 +1,39 @@
+#include "arena.h"
+#include <algorithm>
+
+namespace GifFile {
+
+    Arena::~Arena() {
+        for (auto& block : m_blocks) {
+            delete[] block.data;
+        }
+    }
+
+    size_t Arena::capacity() const {
+        size_t total = 0;
+        for (auto& block : m_blocks) {
+            total += block.size;
+        }
+        return total;
+    }
+
+    void* Arena::allocateBytes(size_t size, size_t alignment) {
+        // blocks kept from before the last reset() are used first, in the same order
+        for (; m_current < m_blocks.size(); m_current++, m_offset = 0) {
+            Block& block = m_blocks[m_current];
+            size_t start = (m_offset + alignment - 1) & ~(alignment - 1);
+            if (start + size <= block.size) {
+                m_offset = start + size;
+                return block.data + start;
+            }
+        }
+
+        // no block has room left. Every new block is at least as big as all the others together, so there are few of them
+        size_t blockSize = std::max(std::max(m_blockSize, capacity()), size);
+        m_blocks.push_back(Block{new uint8_t[blockSize], blockSize});
+        m_current = m_blocks.size() - 1;
+        m_offset = size;
+        return m_blocks[m_current].data; // new[] memory is aligned for any type
+    }
+
+} // namespace GifFile
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+#include <type_traits>
+
+
+namespace GifFile {
+    /*
+     * Bump allocator. Memory is handed out from large blocks and is only given back all at once, by reset() or the destructor.
+     * reset() keeps the blocks, so reading another file of a similar size does not allocate again.
+     */
+    class Arena {
+    public:
+        Arena(size_t blockSize = 64 * 1024) : m_blockSize(blockSize) {}
+        ~Arena();
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        // returns uninitialised memory for count objects of T. Nothing is ever destructed, so T must not need it
+        template<typename T>
+        T* allocate(size_t count) {
+            static_assert(std::is_trivially_destructible<T>::value, "arena memory is released without destructing anything");
+            return (T*)allocateBytes(count * sizeof(T), alignof(T));
+        }
+
+        // makes every block free again. Everything allocated before must not be used anymore
+        void reset() {
+            m_current = 0;
+            m_offset = 0;
+        }
+
+        // bytes held in blocks, used or not
+        size_t capacity() const;
+
+    private:
+        void* allocateBytes(size_t size, size_t alignment);
+
+        struct Block {
+            uint8_t* data;
+            size_t size;
+        };
+        size_t m_blockSize;
+        std::vector<Block> m_blocks;
+        size_t m_current = 0; // block that is allocated from
+        size_t m_offset = 0;  // first free byte of that block
+    };
+} // namespace GifFile
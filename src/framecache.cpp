@@ -0,0 +1,180 @@
+#include "framecache.h"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+namespace GifCache {
+
+    static const char CacheMagic[8] = {'G', 'I', 'F', 'C', 'A', 'C', 'H', 'E'};
+
+    uint64_t hashBytes(const uint8_t* bytes, size_t count) {
+        uint64_t hash = 14695981039346656037ULL;
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * 1099511628211ULL;
+        }
+        for (; i < count; i++) {
+            hash = (hash ^ bytes[i]) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    std::filesystem::path FrameCache::entryPath(const std::string& path) {
+        // the same file reached through another relative path shares the entry
+        std::error_code error;
+        std::string absolute = std::filesystem::weakly_canonical(path, error).string();
+        if (error)
+            absolute = path;
+        char name[32];
+        snprintf(name, sizeof(name), "%016llx.gifcache", (unsigned long long)hashBytes((const uint8_t*)absolute.data(), absolute.size()));
+        return std::filesystem::path(m_directory) / name;
+    }
+
+    bool FrameCache::sourceKey(const std::string& path, CacheHeader& key) {
+        std::error_code error;
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+            return 1;
+        GifFile::MappedFile source;
+        if (source.open(path.c_str()))
+            return 1;
+        key.sourceSize = source.size();
+        key.sourceTime = (int64_t)time.time_since_epoch().count();
+        key.sourceHash = hashBytes(source.data(), source.size());
+        return 0;
+    }
+
+    bool FrameCache::load(GifFile::GifFileReader& reader) {
+        m_entry.close();
+        std::filesystem::path entry = entryPath(reader.filename);
+        std::error_code error;
+        if (!std::filesystem::exists(entry, error) || m_entry.open(entry.string().c_str()))
+            return 1;
+
+        // anything that does not match the source as it is now makes the entry stale
+        CacheHeader key;
+        const CacheHeader* header = (const CacheHeader*)m_entry.data();
+        size_t frameCount = reader.frames.size();
+        bool valid = sourceKey(reader.filename, key) == 0 && m_entry.size() >= sizeof(CacheHeader) &&
+                     memcmp(header->magic, CacheMagic, sizeof(CacheMagic)) == 0 && header->version == CacheVersion &&
+                     header->frameCount == frameCount && m_entry.size() >= sizeof(CacheHeader) + frameCount * sizeof(CacheFrame) &&
+                     header->sourceSize == key.sourceSize && header->sourceTime == key.sourceTime && header->sourceHash == key.sourceHash;
+        const CacheFrame* table = (const CacheFrame*)(m_entry.data() + sizeof(CacheHeader));
+        for (size_t i = 0; valid && i < frameCount; i++) {
+            const GifFile::GifFrame& frame = reader.frames[i];
+            size_t count = (size_t)frame.width * frame.height;
+            valid = table[i].width == frame.width && table[i].height == frame.height && table[i].interlaced == (uint32_t)frame.isInterlaced &&
+                    table[i].offset <= m_entry.size() && count <= m_entry.size() - table[i].offset;
+        }
+        if (!valid) {
+            m_entry.close();
+            std::filesystem::remove(entry, error);
+            return 1;
+        }
+
+        for (size_t i = 0; i < frameCount; i++) {
+            reader.adoptIndices(i, m_entry.data() + table[i].offset);
+        }
+        // the last write time of an entry is when it was last used
+        std::filesystem::last_write_time(entry, std::filesystem::file_time_type::clock::now(), error);
+        return 0;
+    }
+
+    bool FrameCache::store(GifFile::GifFileReader& reader) {
+        CacheHeader header;
+        memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+        header.version = CacheVersion;
+        header.frameCount = (uint32_t)reader.frames.size();
+        if (sourceKey(reader.filename, header))
+            return 1;
+
+        // the indices follow the table, in frame order
+        std::vector<CacheFrame> table(reader.frames.size());
+        uint64_t offset = sizeof(CacheHeader) + table.size() * sizeof(CacheFrame);
+        for (size_t i = 0; i < table.size(); i++) {
+            const GifFile::GifFrame& frame = reader.frames[i];
+            table[i] = CacheFrame{offset, frame.width, frame.height, (uint32_t)frame.isInterlaced};
+            offset += (uint64_t)frame.width * frame.height;
+        }
+        if (offset > m_maxBytes)
+            return 1;
+
+        std::error_code error;
+        std::filesystem::create_directories(m_directory, error);
+        std::filesystem::path entry = entryPath(reader.filename);
+        // written under a name of its own and renamed when complete, so nobody ever maps half an entry
+        std::filesystem::path partial = entry;
+        partial += "." + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count()) + ".tmp";
+        FILE* out = fopen(partial.string().c_str(), "wb");
+        if (out == NULL) {
+            printf("Could not open %s for writing!\n", partial.string().c_str());
+            return 1;
+        }
+
+        bool failed = fwrite(&header, sizeof(header), 1, out) != 1 ||
+                      fwrite(table.data(), sizeof(CacheFrame), table.size(), out) != table.size();
+        std::vector<GifFile::byte> scratch;
+        for (size_t i = 0; i < reader.frames.size() && !failed; i++) {
+            const GifFile::GifFrame& frame = reader.frames[i];
+            size_t count = (size_t)frame.width * frame.height;
+            const GifFile::byte* indices = frame.indices;
+            if (!frame.isDecoded) {
+                scratch.resize(count);
+                try {
+                    reader.decodeIndices(frame, scratch.data());
+                } catch (const std::exception& e) {
+                    printf("Frame %li failed to decode: %s\n", (long)i, e.what());
+                    failed = true;
+                    break;
+                }
+                indices = scratch.data();
+            }
+            failed = fwrite(indices, 1, count, out) != count;
+        }
+        if (fclose(out) != 0 || failed) {
+            std::filesystem::remove(partial, error);
+            return 1;
+        }
+
+        std::filesystem::rename(partial, entry, error);
+        if (error) {
+            std::filesystem::remove(partial, error);
+            return 1;
+        }
+        evict(entry);
+        return 0;
+    }
+
+    void FrameCache::evict(const std::filesystem::path& keep) {
+        struct Entry {
+            std::filesystem::path path;
+            std::filesystem::file_time_type used;
+            uint64_t size;
+        };
+        std::vector<Entry> entries;
+        uint64_t total = 0;
+        std::error_code error;
+        for (auto& file : std::filesystem::directory_iterator(m_directory, error)) {
+            if (file.path().extension() != ".gifcache")
+                continue;
+            std::error_code timeError, sizeError;
+            Entry cached{file.path(), file.last_write_time(timeError), file.file_size(sizeError)};
+            if (timeError || sizeError)
+                continue;
+            total += cached.size;
+            if (!std::filesystem::equivalent(cached.path, keep, timeError))
+                entries.push_back(cached);
+        }
+
+        // least recently used first
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (size_t i = 0; i < entries.size() && total > m_maxBytes; i++) {
+            // an entry that is mapped elsewhere may not be deletable (on Windows), it is then left for later
+            if (std::filesystem::remove(entries[i].path, error))
+                total -= entries[i].size;
+        }
+    }
+
+} // namespace GifCache
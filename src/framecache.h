@@ -0,0 +1,68 @@
+#pragma once
+
+#include "gif.h"
+#include <filesystem>
+
+
+namespace GifCache {
+    // Layout of a cache file is a CacheHeader, a CacheFrame per frame, then the indices of every frame
+    static const uint32_t CacheVersion = 1; // bumped whenever the layout changes, older files are then rebuilt
+
+    // Identifies the source file an entry was built from. An entry is only used if all of it still matches
+    struct CacheHeader {
+        char magic[8]; // "GIFCACHE"
+        uint32_t version;
+        uint32_t frameCount;
+        uint64_t sourceSize;
+        int64_t sourceTime; // last write time of the source, in ticks of std::filesystem::file_time_type
+        uint64_t sourceHash; // of the whole content of the source, see hashBytes()
+    };
+
+    struct CacheFrame {
+        uint64_t offset; // of the indices, from the start of the cache file
+        uint16_t width, height;
+        uint32_t interlaced; // decoded as interlaced (the flag or forced), which changes the row order of the indices
+    };
+
+    // 64 bit FNV-1a over 8 byte words (then the bytes left), fast enough to hash a source on every launch
+    uint64_t hashBytes(const uint8_t* bytes, size_t count);
+
+    /*
+     * Keeps the decoded indices of every frame of a GIF file in a cache file of its own, one per source path, inside a directory.
+     * A cache file is mapped and its indices handed to the reader with GifFileReader::adoptIndices(), so a file that was
+     * played before starts without any LZW decoding. An entry whose source changed (size, last write time or content)
+     * is deleted when it is looked up. The cache files together are kept under a size limit by deleting the least recently
+     * used ones, their last write time is the time they were last used.
+     */
+    class FrameCache {
+    public:
+        // directory is created when the first entry is stored. maxBytes limits the size of all cache files together
+        FrameCache(const std::string& directory, uint64_t maxBytes) : m_directory(directory), m_maxBytes(maxBytes) {}
+
+        /*
+         * looks the file of reader (read with readFile() or scanFile()) up in the cache and makes every frame use the cached
+         * indices. They stay mapped until the next load() or until the cache is destroyed, so it must outlive the reader's use of them
+         * Returns: 0 if every frame now comes from the cache, 1 if there is no valid entry
+         */
+        bool load(GifFile::GifFileReader& reader);
+
+        /*
+         * writes the indices of every frame of reader to its entry, decoding the frames that are not decoded yet one at a time,
+         * then deletes least recently used entries until the cache fits its limit. Entries appear whole or not at all
+         * Returns: 0 on success, 1 on failure (the file could not be decoded or written, or it is larger than the limit)
+         */
+        bool store(GifFile::GifFileReader& reader);
+
+    private:
+        // the cache file of the GIF file at path
+        std::filesystem::path entryPath(const std::string& path);
+        // fills the source fields of key from the file at path. Returns: 0 on success, 1 on failure
+        bool sourceKey(const std::string& path, CacheHeader& key);
+        // deletes the oldest entries, never keep, until the cache fits m_maxBytes
+        void evict(const std::filesystem::path& keep);
+
+        std::string m_directory;
+        uint64_t m_maxBytes;
+        GifFile::MappedFile m_entry; // the loaded entry
+    };
+} // namespace GifCache
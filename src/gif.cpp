@@ -1,5 +1,9 @@
 #include "gif.h"
-#include <assert.h>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <algorithm>
+#include <chrono>
 
 namespace GifFile {
 
@@ -16,11 +20,12 @@ namespace GifFile {
 
     GifLocalImageDescriptorPacked GifFileReader::unpackGifLocalImageDescriptor(GifLocalImageDescriptor& descriptor) {
         byte packed = descriptor.packedByte;
+        // the flags are in the high bits and the color table size in the low bits, like in the header
         return GifLocalImageDescriptorPacked {
-            (bool)((packed & 0b00000001)     ),
-            (bool)((packed & 0b00000010)  >> 1),
-            (bool)((packed & 0b00000100)  >> 2),
-            (dword)((packed & 0b11100000) >> 5)
+            (bool)((packed & 0b10000000)  >> 7),
+            (bool)((packed & 0b01000000)  >> 6),
+            (bool)((packed & 0b00100000)  >> 5),
+            (dword)((packed & 0b00000111)     )
         };
     }
 
@@ -33,13 +38,246 @@ namespace GifFile {
         };
     }
 
+    bool GifFileReader::skipSubBlocks(const byte*& p) {
+        // only the length bytes are looked at, the data itself is jumped over
+        while (p < m_end) {
+            byte blockSize = *p++;
+            if (blockSize == 0)
+                return true;
+            if ((size_t)(m_end - p) < blockSize) {
+                p = m_end;
+                return false;
+            }
+            p += blockSize;
+        }
+        return false;
+    }
+
+    static uint64_t nsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // fills rows with the stored row that belongs at every row of an interlaced image of the given height
+    static void interlacedRowOrder(word height, word* rows) {
+        // rows are stored in 4 passes: every 8th row from row 0, every 8th from row 4, every 4th from row 2, every 2nd from row 1
+        static const word passStart[4] = {0, 4, 2, 1};
+        static const word passStep[4] = {8, 8, 4, 2};
+        word stored = 0;
+        for (int pass = 0; pass < 4; pass++) {
+            for (size_t row = passStart[pass]; row < height; row += passStep[pass]) {
+                rows[row] = stored++;
+            }
+        }
+    }
+
+    void GifFileReader::deinterlace(const GifFrame& frame, byte* indices) {
+        const word* rows = nullptr;
+        for (auto& table : m_interlacedRows) {
+            if (table.first == frame.height)
+                rows = table.second;
+        }
+        /* every row is swapped into place once. A stored row that was already swapped away is found
+           by following the rows it was swapped with, so no second buffer is needed */
+        for (size_t row = 0; row < frame.height; row++) {
+            size_t source = rows[row];
+            while (source < row)
+                source = rows[source];
+            if (source != row)
+                std::swap_ranges(indices + row * frame.width, indices + (row + 1) * frame.width, indices + source * frame.width);
+        }
+    }
+
+    void GifFileReader::applyGraphicControl(GifFrame& frame, GifGraphicControlExtension& extension) {
+        auto extPacked = unpackGifGraphicControlExtension(extension);
+        if(m_verbose) {
+            printf("\tTime on screen: %i*10 ms\n\tDisposal Method: %i\n\tTransparency Flag: %i\n",
+                extension.delayTime,
+                extPacked.disposalMethod,
+                extPacked.transparencyFlag
+            );
+        }
+
+        frame.clearBuffer = (extPacked.disposalMethod == 2);
+        frame.disposalMethod = extPacked.disposalMethod;
+        frame.delayTime = extension.delayTime * 10; // GifGraphicControlExtension::delayTime hundreths of a second not milliseconds 
+        frame.hasTransparency = extPacked.transparencyFlag;
+        frame.transparencyIndex = extension.transparentIndex;
+    }
+
+    void GifFileReader::beginFrame(GifFrame& frame, GifLocalImageDescriptor& descriptor) {
+        frame.width = descriptor.width;
+        frame.height = descriptor.height;
+        frame.left = descriptor.left;
+        frame.top = descriptor.top;
+        frame.isInterlaced = unpackGifLocalImageDescriptor(descriptor).interlaceFlag || m_forceInterlace;
+        if (frame.isInterlaced && std::none_of(m_interlacedRows.begin(), m_interlacedRows.end(),
+                                               [&](const std::pair<word, const word*>& table) { return table.first == frame.height; })) {
+            word* rows = m_arena.allocate<word>(frame.height);
+            interlacedRowOrder(frame.height, rows);
+            m_interlacedRows.push_back(std::make_pair(frame.height, rows));
+        }
+    }
+
+    void GifFileReader::decodeIndices(const GifFrame& frame, byte* out) {
+        auto start = std::chrono::steady_clock::now();
+        size_t pixelCount = (size_t)frame.width * frame.height;
+        GifLZW::LzwDecoder decoder(frame.imageData, frame.imageDataSize, frame.lzwMinCodeSize);
+        size_t decoded = decoder.decode(out, pixelCount, m_verbose >= 2); // 2 - LZW log level
+        // pixels missing from a short stream are left transparent (or use the first color if there is no transparency)
+        if (decoded < pixelCount) {
+            memset(out + decoded, frame.hasTransparency ? frame.transparencyIndex : 0, pixelCount - decoded);
+        }
+        if (frame.isInterlaced)
+            deinterlace(frame, out);
+
+        const GifLZW::LzwCounters& lzw = decoder.counters();
+        frame.counters.codes += lzw.codes;
+        frame.counters.clearCodes += lzw.clearCodes;
+        frame.counters.dictionaryResets += lzw.dictionaryResets;
+        frame.counters.decodeNs += nsSince(start);
+        frame.counters.decodes++;
+    }
+
+    FrameCounters GifFileReader::totalCounters() const {
+        FrameCounters total;
+        for (auto& frame : frames) {
+            total.add(frame.counters);
+        }
+        return total;
+    }
+
+    void GifFileReader::printCounters(FILE* out) const {
+        auto print = [out](const char* name, const FrameCounters& c) {
+            fprintf(out, "%8s %9llu %7llu %7llu %9llu %11.3f %11.3f %11.3f %7u %7u\n", name,
+                    (unsigned long long)c.codes, (unsigned long long)c.clearCodes, (unsigned long long)c.dictionaryResets, (unsigned long long)c.bytesParsed,
+                    c.parseNs / 1e6, c.decodeNs / 1e6, c.compositeNs / 1e6, c.decodes, c.composites);
+        };
+
+        fprintf(out, "Counters for %s:\n", filename.c_str());
+        fprintf(out, "%8s %9s %7s %7s %9s %11s %11s %11s %7s %7s\n", "frame", "codes", "clears", "resets", "bytes",
+                "parse ms", "decode ms", "compose ms", "decodes", "drawn");
+        char name[24];
+        for (size_t i = 0; i < frames.size(); i++) {
+            snprintf(name, sizeof(name), "%lu", (unsigned long)i);
+            print(name, frames[i].counters);
+        }
+        print("total", totalCounters());
+    }
+
+    void GifFileReader::adoptIndices(size_t i, const byte* indices) {
+        GifFrame& frame = frames[i];
+        frame.indices = const_cast<byte*>(indices);
+        frame.isDecoded = true;
+    }
+
+    void GifFileReader::decodeFrame(GifFrame& frame) {
+        if(m_verbose) { printf("Decoding LZW compressed data...\n"); }
+
+        // in parallel mode readFile() allocated the buffer
+        if (frame.indices == nullptr)
+            frame.indices = m_arena.allocate<byte>((size_t)frame.width * frame.height);
+        decodeIndices(frame, frame.indices);
+        frame.isDecoded = true;
+
+        if(m_verbose) { printf("Done.\n"); }
+    }
+
+    void GifFileReader::decodeFramesParallel(unsigned threadCount) {
+        std::atomic<size_t> nextFrame(0);
+        std::vector<std::exception_ptr> errors(frames.size());
+
+        // frames are independent, so every worker simply takes the next frame that nobody decoded yet
+        auto worker = [&]() {
+            size_t i;
+            while ((i = nextFrame.fetch_add(1)) < frames.size()) {
+                try {
+                    decodeFrame(frames[i]);
+                } catch (...) {
+                    errors[i] = std::current_exception();
+                }
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (unsigned t = 1; t < threadCount; t++) {
+            workers.emplace_back(worker);
+        }
+        worker(); // the calling thread works too
+        for (auto& thread : workers) {
+            thread.join();
+        }
+
+        // report the same error the serial path would have hit first
+        for (auto& error : errors) {
+            if (error)
+                std::rethrow_exception(error);
+        }
+    }
+
+    GifFrame& GifFileReader::getFrame(size_t i) {
+        GifFrame& frame = frames[i];
+        // a frame that was only scanned is decoded into a buffer of its own, which it keeps
+        if (!frame.isDecoded)
+            decodeFrame(frame);
+        return frame;
+    }
+
+    void GifFileReader::reset(const char* fileName) {
+        filename = fileName;
+        frames.clear();
+        m_file.close();
+        m_arena.reset();
+        globalColorTable = nullptr;
+        m_interlacedRows.clear();
+        // the stream parser starts over too, but keeps the memory of its image data buffer
+        m_stream.state = StreamState::Header;
+        m_stream.pieceSize = 0;
+        m_stream.pieceNeeded = sizeof(GifHeader);
+        m_stream.subBlockLeft = 0;
+        m_stream.imageData.clear();
+        m_stream.frame = GifFrame{};
+        m_stream.offset = m_stream.frameStart = 0;
+    }
+
     bool GifFileReader::readFile() {
-        m_file = fopen(filename.c_str(), "rb");
-        fseek(m_file, 0, SEEK_END);
-        m_filesize = ftell(m_file);
-        fseek(m_file, 0, SEEK_SET);
+        if (m_file.open(filename.c_str())) {
+            printf("Could not open %s!\n", filename.c_str());
+            return 1;
+        }
+        return readMemory(m_file.data(), m_file.size());
+    }
+
+    bool GifFileReader::scanFile() {
+        m_scanOnly = true;
+        bool failed = readFile();
+        m_scanOnly = false;
+        return failed;
+    }
+
+    bool GifFileReader::scanMemory(const byte* data, size_t size) {
+        m_scanOnly = true;
+        bool failed = readMemory(data, size);
+        m_scanOnly = false;
+        return failed;
+    }
+
+    uint64_t GifFileReader::totalDuration() const {
+        uint64_t duration = 0;
+        for (auto& frame : frames) {
+            duration += frame.delayTime;
+        }
+        return duration;
+    }
+
+    bool GifFileReader::readMemory(const byte* data, size_t size) {
+        const byte* fileStart = data;
+        m_end = fileStart + size;
+        const byte* p = fileStart;
 
-        fread(&gifHeader, sizeof(GifHeader), 1, m_file);
+        if (!readStruct(p, gifHeader)) {
+            printf("File is too small to be a GIF!\n");
+            return 1;
+        }
         if (checkHeader(gifHeader)) // Magic or Version are invalid
             return 1;
         gifHeaderPacked = unpackGifHeader(gifHeader);
@@ -56,134 +294,349 @@ namespace GifFile {
         // Set The index of the color to be used when clearing the screen
         backgroundColorIndex = gifHeader.bgColorIdx;
 
-        // Populate the Global Color Table
-        globalColorTable = new GifGctColorEntry[gifHeaderPacked.gctEntryCount];
-        fread(globalColorTable, 3*gifHeaderPacked.gctEntryCount, 1, m_file);
+        // Populate the Global Color Table. It is padded to 256 entries so any index can be looked up safely
+        globalColorTable = m_arena.allocate<GifGctColorEntry>(256);
+        memset(globalColorTable, 0, sizeof(GifGctColorEntry) * 256);
+        if (gifHeaderPacked.gctFlag) {
+            size_t gctSize = sizeof(GifGctColorEntry) * gifHeaderPacked.gctEntryCount;
+            if ((size_t)(m_end - p) < gctSize) {
+                printf("File ended inside the Global Color Table!\n");
+                return 1;
+            }
+            memcpy(globalColorTable, p, gctSize);
+            p += gctSize;
+        }
 
 
 
+        unsigned threadCount = m_decodeThreads;
+        if (threadCount == 0)
+            threadCount = std::max(1U, std::thread::hardware_concurrency());
+        // LZW logs from several threads would be interleaved, so they are only available serially
+        if (m_verbose >= 2)
+            threadCount = 1;
+
         // loop until all frames have been read
+        GifFrame thisFrame{};
+        const byte* frameStart = p; // the extensions before an image belong to its frame
+        auto parseStart = std::chrono::steady_clock::now();
         while (true) {
-            GifFrame thisFrame{};
-
-            byte identifier = 0x00;
-            while (true) {
-                fread(&identifier, 1, 1, m_file);
-                // found an image, 0x2C = LocalImageDescriptor
-                if (identifier == 0x2C) {
-                    if (m_verbose) { printf("Local Image Descriptor (offset %li)\n", ftell(m_file)); }
-                    fseek(m_file, -1, SEEK_CUR); // Seek back so Local Image Descriptor has the ID
-                    break; // jump straight to reading the LocalImageDescriptor and the compressed data
-                
-                // 0x21 = Extension
-                } else if (identifier == 0x21) {
-                    byte extensionType;
-                    fread(&extensionType, 1, 1, m_file);
-
-                    if (extensionType == 0xF9) { // 0xF9 = Graphic Control Extension
-                        if(m_verbose) { printf("Graphic Control Extension (offset %li):\n", ftell(m_file)); }
-
-                        byte extensionSize;
-                        fread(&extensionSize, 1, 1, m_file);
-                        
-                        // confirm program is reading the correct thing
-                        assert(extensionSize == sizeof(GifGraphicControlExtension));
-
-                        GifGraphicControlExtension extension;
-                        fread(&extension, sizeof(GifGraphicControlExtension), 1, m_file);
-                        auto extPacked = unpackGifGraphicControlExtension(extension);
-                    
-                        if(m_verbose) {
-                            printf("\tTime on screen: %i*10 ms\n\tDisposal Method: %i\n\tTransparency Flag: %i\n",
-                                extension.delayTime,
-                                extPacked.disposalMethod,
-                                extPacked.transparencyFlag
-                            );
-                        }
+            if (p >= m_end) {
+                printf("File ended without a trailer. Stopping after %li frames.\n", frames.size());
+                break;
+            }
+
+            byte identifier = *p++;
+            // 3B is a unique byte that marks the end of the file
+            if (identifier == 0x3B)
+                break;
+
+            // 0x21 = Extension
+            if (identifier == 0x21) {
+                if (p >= m_end)
+                    continue;
+                byte extensionType = *p++;
+
+                if (extensionType == 0xF9) { // 0xF9 = Graphic Control Extension
+                    if(m_verbose) { printf("Graphic Control Extension (offset %li):\n", (long)(p - fileStart)); }
 
+                    // confirm program is reading the correct thing. The size byte is left in place when it is wrong,
+                    // so the whole extension is skipped as a sub-block below
+                    GifGraphicControlExtension extension;
+                    if (p < m_end && *p == sizeof(GifGraphicControlExtension) && readStruct(++p, extension)) {
                         // Set the current frame metadata
-                        thisFrame.clearBuffer = (extPacked.disposalMethod == 2);
-                        thisFrame.delayTime = extension.delayTime * 10; // GifGraphicControlExtension::delayTime hundreths of a second not milliseconds 
-                        thisFrame.hasTransparency = extPacked.transparencyFlag;
-                        thisFrame.transparencyIndex = extension.transparentIndex;
+                        applyGraphicControl(thisFrame, extension);
+                    } else if (m_verbose) {
+                        printf("Malformed Graphic Control Extension, ignoring it.\n");
                     }
-                } 
-            } // end of extension and descriptor search
+                }
+                // skip whatever is left of the extension (all of it for application, comment and plain text extensions)
+                skipSubBlocks(p);
+                continue;
+            }
+
+            // 0x2C = LocalImageDescriptor
+            if (identifier != 0x2C) {
+                printf("Unknown block %#04x at offset %li. Stopping after %li frames.\n", identifier, (long)(p - 1 - fileStart), frames.size());
+                break;
+            }
+            if (m_verbose) { printf("Local Image Descriptor (offset %li)\n", (long)(p - fileStart)); }
+            p--; // Local Image Descriptor includes the ID
 
             // Store Local Image Descriptor Data
             GifLocalImageDescriptor localImageDescriptor;
-            fread(&localImageDescriptor, sizeof(GifLocalImageDescriptor), 1, m_file);
-            GifLocalImageDescriptorPacked localImageDescriptorPacked = unpackGifLocalImageDescriptor(localImageDescriptor);
-            if (m_verbose && localImageDescriptorPacked.lctFlag) {
-                printf("Local Image Descriptor has LCT flag set.\n");
+            if (!readStruct(p, localImageDescriptor)) {
+                printf("File ended inside a Local Image Descriptor!\n");
+                break;
             }
-            
+            GifLocalImageDescriptorPacked localImageDescriptorPacked = unpackGifLocalImageDescriptor(localImageDescriptor);
             
             // Set frame metadata again
-            thisFrame.width = localImageDescriptor.width;
-            thisFrame.height = localImageDescriptor.height;
-            thisFrame.left = localImageDescriptor.left;
-            thisFrame.top = localImageDescriptor.top;
-            thisFrame.isInterlaced = localImageDescriptorPacked.interlaceFlag;
+            beginFrame(thisFrame, localImageDescriptor);
+
+            // the Local Color Table follows the descriptor and is used in place
+            if (localImageDescriptorPacked.lctFlag) {
+                dword lctEntryCount = (dword)1 << (localImageDescriptorPacked.lctEntrySize + 1);
+                if (m_verbose) { printf("Local Image Descriptor has LCT flag set (%i entries).\n", lctEntryCount); }
+                if ((size_t)(m_end - p) < sizeof(GifGctColorEntry) * lctEntryCount) {
+                    printf("File ended inside a Local Color Table!\n");
+                    break;
+                }
+                thisFrame.localColorTable = (const GifGctColorEntry*)p;
+                thisFrame.lctEntryCount = lctEntryCount;
+                p += sizeof(GifGctColorEntry) * lctEntryCount;
+            }
 
             // After the Local Image Descriptor, the image data should exist
 
             /* the base amount of bits required for LZW to work. They decide the dictionary size.
                This byte is always the first in the compressed data. */
-            byte lzwMinCodeSize;
-            fread(&lzwMinCodeSize, 1, 1, m_file);
+            if (p >= m_end) {
+                printf("File ended before the image data!\n");
+                break;
+            }
+            byte lzwMinCodeSize = *p++;
             if(m_verbose) { printf("LZW minimum code size: %i\n",lzwMinCodeSize); }
 
-            // Read the image data
-            if(m_verbose) { printf("Reading image data...\n"); }
-            
-            
-            std::vector<byte> compressedData;
+            /* The image data is split in sub-blocks, every block begins with a one byte size, meaning that any block has the size of 0-255.
+               The decoder reads the blocks directly from the mapped file, so here they only need to be stepped over. */
+            thisFrame.imageData = p;
+            thisFrame.lzwMinCodeSize = lzwMinCodeSize;
+            bool complete = skipSubBlocks(p);
+            thisFrame.imageDataSize = p - thisFrame.imageData;
+            thisFrame.counters.bytesParsed = p - frameStart;
+            thisFrame.counters.parseNs = nsSince(parseStart);
+
+            // in parallel mode the frames are decoded after the scan
+            if (threadCount == 1 && !m_scanOnly)
+                decodeFrame(thisFrame);
+
+            if(m_verbose) { printf("Storing frame...\n"); }
+            frames.push_back(thisFrame);
+            thisFrame = GifFrame{};
+            if(m_verbose) { printf("Done!\n"); }
+            frameStart = p;
+            parseStart = std::chrono::steady_clock::now();
 
-            // Every block of an image begins with a one byte size, meaning that any block has the size of 0-255
-            byte blockSize;
-            fread(&blockSize,1,1,m_file);
+            if (!complete) {
+                printf("File ended inside the image data. Stopping after %li frames.\n", frames.size());
+                break;
+            }
+            if (m_frameLimit != 0 && frames.size() >= m_frameLimit)
+                break;
+        }
+        if (threadCount > 1 && !m_scanOnly) {
+            if(m_verbose) { printf("Decoding %li frames on %i threads...\n", frames.size(), threadCount); }
+            // the arena is not thread safe, so the buffers are handed out before the threads start
+            for (auto& frame : frames) {
+                frame.indices = m_arena.allocate<byte>((size_t)frame.width * frame.height);
+            }
+            decodeFramesParallel(threadCount);
+        }
+        if(m_verbose) { printf("Stored all %li frames!\n",frames.size()); }
+        
+        return frames.empty();
+    }
 
-            // if a block size of 0 appears, it means that there are no more blocks to be read
-            uint32_t offset = 0;
-            while (blockSize > 0) {
-                std::vector<byte> tmp;
-                tmp.reserve(blockSize);
-                fread(tmp.data(), blockSize,1,m_file);
 
-                for (size_t i = 0; i < blockSize; i++) {
-                    compressedData.push_back(tmp[i]);
+    bool GifFileReader::feed(const byte* data, size_t size) {
+        StreamParser& st = m_stream;
+        const byte* p = data;
+        const byte* end = data + size;
+        auto parseStart = std::chrono::steady_clock::now();
+        while (p < end && st.state != StreamState::Ended && st.state != StreamState::Failed) {
+            const byte* chunkStart = p;
+            if (st.state == StreamState::ExtensionBlocks || st.state == StreamState::ImageBlocks) {
+                bool image = st.state == StreamState::ImageBlocks;
+                if (st.subBlockLeft == 0) {
+                    byte blockSize = *p++;
+                    if (image)
+                        st.imageData.push_back(blockSize);
+                    if (blockSize == 0) {
+                        st.offset += 1;
+                        if (image) {
+                            st.frame.counters.parseNs += nsSince(parseStart);
+                            streamFrame();
+                            parseStart = std::chrono::steady_clock::now();
+                        } else {
+                            expectPiece(StreamState::Block, 1);
+                        }
+                        continue;
+                    }
+                    st.subBlockLeft = blockSize;
+                }
+                // the data of extensions is jumped over, image data is kept
+                size_t count = std::min<size_t>(st.subBlockLeft, end - p);
+                if (image)
+                    st.imageData.insert(st.imageData.end(), p, p + count);
+                p += count;
+                st.subBlockLeft -= count;
+            } else {
+                size_t count = std::min<size_t>(st.pieceNeeded - st.pieceSize, end - p);
+                memcpy(st.piece + st.pieceSize, p, count);
+                st.pieceSize += count;
+                p += count;
+                if (st.pieceSize == st.pieceNeeded) {
+                    st.offset += p - chunkStart;
+                    chunkStart = p;
+                    streamPiece();
                 }
-                
+            }
+            st.offset += p - chunkStart;
+        }
+        st.frame.counters.parseNs += nsSince(parseStart);
+        return st.state == StreamState::Failed;
+    }
 
-                offset += blockSize;
-                fread(&blockSize,1,1,m_file);
+    void GifFileReader::streamPiece() {
+        StreamParser& st = m_stream;
+        switch (st.state) {
+            case StreamState::Header: {
+                memcpy(&gifHeader, st.piece, sizeof(GifHeader));
+                if (checkHeader(gifHeader)) {
+                    st.state = StreamState::Failed;
+                    return;
+                }
+                gifHeaderPacked = unpackGifHeader(gifHeader);
+                backgroundColorIndex = gifHeader.bgColorIdx;
+                globalColorTable = m_arena.allocate<GifGctColorEntry>(256);
+                memset(globalColorTable, 0, sizeof(GifGctColorEntry) * 256);
+                if (gifHeaderPacked.gctFlag)
+                    expectPiece(StreamState::GlobalColorTable, sizeof(GifGctColorEntry) * gifHeaderPacked.gctEntryCount);
+                else
+                    expectPiece(StreamState::Block, 1);
+                st.frameStart = st.offset;
+                break;
+            }
+            case StreamState::GlobalColorTable:
+                memcpy(globalColorTable, st.piece, st.pieceSize);
+                expectPiece(StreamState::Block, 1);
+                st.frameStart = st.offset;
+                break;
+            case StreamState::Block:
+                // 3B is a unique byte that marks the end of the file
+                if (st.piece[0] == 0x3B) {
+                    st.state = StreamState::Ended;
+                } else if (st.piece[0] == 0x21) {
+                    expectPiece(StreamState::ExtensionLabel, 1);
+                } else if (st.piece[0] == 0x2C) {
+                    // the Local Image Descriptor includes the ID, which is already in the piece
+                    st.state = StreamState::ImageDescriptor;
+                    st.pieceNeeded = sizeof(GifLocalImageDescriptor);
+                } else {
+                    printf("Unknown block %#04x at offset %li. Stopping after %li frames.\n", st.piece[0], (long)st.offset - 1, frames.size());
+                    st.state = StreamState::Ended;
+                }
+                break;
+            case StreamState::ExtensionLabel:
+                if (st.piece[0] == 0xF9) { // 0xF9 = Graphic Control Extension
+                    expectPiece(StreamState::GraphicControlSize, 1);
+                } else {
+                    st.state = StreamState::ExtensionBlocks;
+                    st.subBlockLeft = 0;
+                }
+                break;
+            case StreamState::GraphicControlSize:
+                if (st.piece[0] == sizeof(GifGraphicControlExtension)) {
+                    expectPiece(StreamState::GraphicControl, sizeof(GifGraphicControlExtension));
+                } else {
+                    // a malformed extension is skipped as sub-blocks, the size byte being the first length
+                    if (m_verbose) { printf("Malformed Graphic Control Extension, ignoring it.\n"); }
+                    st.state = StreamState::ExtensionBlocks;
+                    st.subBlockLeft = st.piece[0];
+                    if (st.subBlockLeft == 0)
+                        expectPiece(StreamState::Block, 1);
+                }
+                break;
+            case StreamState::GraphicControl: {
+                GifGraphicControlExtension extension;
+                memcpy(&extension, st.piece, sizeof(extension));
+                applyGraphicControl(st.frame, extension);
+                st.state = StreamState::ExtensionBlocks;
+                st.subBlockLeft = 0;
+                break;
             }
+            case StreamState::ImageDescriptor: {
+                GifLocalImageDescriptor descriptor;
+                memcpy(&descriptor, st.piece, sizeof(descriptor));
+                beginFrame(st.frame, descriptor);
+                GifLocalImageDescriptorPacked packed = unpackGifLocalImageDescriptor(descriptor);
+                if (packed.lctFlag) {
+                    st.frame.lctEntryCount = (dword)1 << (packed.lctEntrySize + 1);
+                    expectPiece(StreamState::LocalColorTable, sizeof(GifGctColorEntry) * st.frame.lctEntryCount);
+                } else {
+                    expectPiece(StreamState::LzwMinCodeSize, 1);
+                }
+                break;
+            }
+            case StreamState::LocalColorTable: {
+                // the piece is reused, so the table is copied next to the rest of the file's data
+                GifGctColorEntry* table = m_arena.allocate<GifGctColorEntry>(st.frame.lctEntryCount);
+                memcpy(table, st.piece, st.pieceSize);
+                st.frame.localColorTable = table;
+                expectPiece(StreamState::LzwMinCodeSize, 1);
+                break;
+            }
+            case StreamState::LzwMinCodeSize:
+                st.frame.lzwMinCodeSize = st.piece[0];
+                st.imageData.clear();
+                st.state = StreamState::ImageBlocks;
+                st.subBlockLeft = 0;
+                break;
+            default:
+                break;
+        }
+    }
 
-            if(m_verbose) { printf("Decoding LZW compressed data...\n"); }
-            
-            GifLZW::LzwDecoder decoder(compressedData.data(), lzwMinCodeSize);
-            thisFrame.indices = decoder.decode(m_verbose >= 2); // 2 - LZW log level
-            
-            if(m_verbose) { printf("Done.\n"); }
+    void GifFileReader::streamFrame() {
+        StreamParser& st = m_stream;
+        GifFrame& frame = st.frame;
+        byte* imageData = m_arena.allocate<byte>(st.imageData.size());
+        memcpy(imageData, st.imageData.data(), st.imageData.size());
+        frame.imageData = imageData;
+        frame.imageDataSize = st.imageData.size();
+        frame.counters.bytesParsed = st.offset - st.frameStart;
+        st.frameStart = st.offset;
 
-            if(m_verbose) { printf("Storing frame...\n"); }
-            frames.push_back(thisFrame);
-            if(m_verbose) { printf("Done!\n"); }
+        if (!m_scanOnly)
+            decodeFrame(frame);
+        frames.push_back(frame);
+        frame = GifFrame{};
+        if (m_frameLimit != 0 && frames.size() >= m_frameLimit)
+            st.state = StreamState::Ended;
+        else
+            expectPiece(StreamState::Block, 1);
+    }
 
+    bool GifFileReader::endStream() {
+        if (m_stream.state == StreamState::ImageBlocks) {
+            // what arrived of the image data is decoded, the rest of the frame stays transparent
+            streamFrame();
+            printf("File ended inside the image data. Stopping after %li frames.\n", frames.size());
+        } else if (m_stream.state != StreamState::Ended && m_stream.state != StreamState::Failed) {
+            printf("File ended without a trailer. Stopping after %li frames.\n", frames.size());
+        }
+        m_stream.state = StreamState::Ended;
+        return frames.empty();
+    }
 
-            byte stopByte;
-            fread(&stopByte, 1, 1, m_file);
-            // 3B is a unique byte that should not appear anywhere else after an image except for the end of the file
-            if (stopByte == 0x3B)
-                break; // EOF has been reached
-            fseek(m_file, -1, SEEK_CUR); // If, not EOF seek back so the other functions can handle this byte
+    bool GifFileReader::readStream(FILE* in) {
+        byte chunk[64 * 1024];
+        size_t count;
+        while ((count = fread(chunk, 1, sizeof(chunk), in)) > 0) {
+            if (feed(chunk, count))
+                return 1;
+            if (streamEnded())
+                break;
         }
-        if(m_verbose) { printf("Stored all %li frames!\n",frames.size()); }
-        
+        return endStream();
+    }
 
-        fclose(m_file);
-        return 0;
+    bool GifFileReader::scanStream(FILE* in) {
+        m_scanOnly = true;
+        bool failed = readStream(in);
+        m_scanOnly = false;
+        return failed;
     }
     
 } // namespace GifFile
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "lzw.h"
+#include "mapfile.h"
+#include "arena.h"
 #include <vector>
 #include <string.h>
 #include <string>
@@ -62,7 +64,7 @@ namespace GifFile {
 
     // Contents of GifGraphicControlExtension::packedByte
     struct GifGraphicControlExtensionPacked {
-        byte disposalMethod; // 1 do not clear buffer, 2 clear buffer to bg color, 3 rarely used
+        byte disposalMethod; // 1 do not clear buffer, 2 clear buffer to bg color, 3 restore what was there before the frame
         bool userInputFlag; // Wait for user input. Rarely used
         bool transparencyFlag;
     };
@@ -71,21 +73,52 @@ namespace GifFile {
         byte r, g, b;
     };
 
+    /* Statistics of one frame, summed over every time it was decoded or composited (lazy playback does both once per loop).
+       They are always collected, the cost is a couple of clock reads per frame and stage. */
+    struct FrameCounters {
+        uint64_t codes = 0, clearCodes = 0, dictionaryResets = 0; // see GifLZW::LzwCounters
+        uint64_t bytesParsed = 0; // bytes of the file taken by the frame: its extensions, descriptor, color table and image data
+        uint64_t parseNs = 0, decodeNs = 0, compositeNs = 0; // time spent in every stage
+        uint32_t decodes = 0, composites = 0;
+
+        void add(const FrameCounters& other) {
+            codes += other.codes;
+            clearCodes += other.clearCodes;
+            dictionaryResets += other.dictionaryResets;
+            bytesParsed += other.bytesParsed;
+            parseNs += other.parseNs;
+            decodeNs += other.decodeNs;
+            compositeNs += other.compositeNs;
+            decodes += other.decodes;
+            composites += other.composites;
+        }
+    };
+
     // Container for a frame
     struct GifFrame {
-        word delayTime; // time on screen in milliseconds
+        dword delayTime; // time on screen in milliseconds
         word width, height;
         word left, top; // x, y position of image rectangle on image canvas
         bool clearBuffer; // should the screen buffer be cleared to its background color when drawing
+        byte disposalMethod; // what happens to the frame rectangle after the frame was shown, see GifGraphicControlExtensionPacked
         bool hasTransparency;
         word transparencyIndex;
-        std::vector<uint32_t> indices; // raw decompressed GCT indices
+        byte* indices = nullptr; // raw decompressed GCT indices, width*height of them. Owned by the reader (unless adopted), nullptr until decoded
         bool isInterlaced;
+        const GifGctColorEntry* localColorTable; // points into the mapped file, nullptr if the frame uses the GCT
+        dword lctEntryCount;
+        const byte* imageData; // first image data sub-block, in the mapped file or (for a fed stream) copied to the reader
+        size_t imageDataSize; // bytes of sub-blocks from imageData on, the terminator included
+        byte lzwMinCodeSize;
+        bool isDecoded; // indices hold the decoded frame
+        /* updated by whoever decodes or composites the frame, even through a const reference.
+           Decoding and compositing write different fields, so they may happen on different threads */
+        mutable FrameCounters counters;
         
         std::vector<GifGctColorEntry> asPixels(GifGctColorEntry* colorTable) {
-            std::vector<GifGctColorEntry> ret;
-            for (auto&& index : indices) {
-                ret.push_back(colorTable[index]);
+            std::vector<GifGctColorEntry> ret((size_t)width * height);
+            for (size_t i = 0; i < ret.size(); i++) {
+                ret[i] = colorTable[indices[i]];
             }
             return ret;
         }
@@ -94,14 +127,82 @@ namespace GifFile {
     class GifFileReader {
     public:
         GifFileReader(const char* fileName, uint8_t verbose = 0) : filename(fileName), m_verbose(verbose) {}
-        ~GifFileReader() {
-            delete[] globalColorTable;
-        }
+
+        /* forgets the current file so that fileName can be read next. Everything the previous file used is released at once
+           but kept for reuse, so reading many files with one reader stops allocating once the largest file has been read */
+        void reset(const char* fileName);
         /* 
-         * reads the GIF file and stores the results in GifFileReader::frames
+         * maps the GIF file into memory and stores the results in GifFileReader::frames
          * Returns: 0 on success, 1 on failure
          */
         bool readFile();
+        /*
+         * same as readFile(), for a GIF file that is already in memory. data is used in place,
+         * so it must stay alive and unchanged as long as the reader is used
+         * Returns: 0 on success, 1 on failure
+         */
+        bool readMemory(const byte* data, size_t size);
+
+        /*
+         * reads only the structure of the file: the header, the color tables and the metadata of every frame.
+         * Image data is stepped over using its sub-block lengths and never decoded, whatever the decode settings are.
+         * The frames can still be decoded later with decodeIndices()
+         * Returns: 0 on success, 1 on failure
+         */
+        bool scanFile();
+        bool scanMemory(const byte* data, size_t size);
+
+        /*
+         * push mode, for input that is not a file or has not fully arrived: parses the next size bytes of the file, in pieces of
+         * any size. The position inside the blocks and sub-blocks is kept between calls. A frame is added to frames as soon as
+         * its image data is complete, and can be decoded right away. The color tables and image data are copied into the reader,
+         * so data does not need to stay alive. Start every file with reset(); the frame limit and forced
+         * interlacing are honored, frames are never decoded on several threads.
+         * Returns: 0 on success, 1 once the data turned out not to be a GIF file
+         */
+        bool feed(const byte* data, size_t size);
+        /* tells the parser that nothing more will be fed. A frame whose image data was cut off is kept, like readFile() does
+           Returns: 0 if there is at least one frame, 1 otherwise */
+        bool endStream();
+        // true once the trailer, or a block that ends parsing, has been fed
+        bool streamEnded() const { return m_stream.state == StreamState::Ended; }
+        // feeds everything that can be read from in (a pipe or stdin) and ends the stream. Returns: 0 on success, 1 on failure
+        bool readStream(FILE* in);
+        // same as readStream(), but like scanFile() the frames are only parsed and never decoded
+        bool scanStream(FILE* in);
+
+        // time the animation takes to play once, the delays of all frames added up (in milliseconds)
+        uint64_t totalDuration() const;
+
+        /*
+         * Decodes the frames on threadCount worker threads. readFile() first scans the whole file for the frames,
+         * then every worker decodes whole frames until none are left. 0 uses one thread per core, 1 (the default)
+         * decodes while parsing. Must be called before readFile().
+         */
+        void setDecodeThreads(unsigned threadCount) { m_decodeThreads = threadCount; }
+
+        // stops reading the file after frameCount frames, the rest of the file is never touched. 0 (the default) reads every frame
+        void setFrameLimit(size_t frameCount) { m_frameLimit = frameCount; }
+
+        // treats every frame as interlaced, for files that do not set the flag. Must be called before readFile()
+        void setForceInterlace(bool forceInterlace) { m_forceInterlace = forceInterlace; }
+
+        /* returns frame i, decoding it first if it is not decoded yet (after scanFile() or scanMemory()).
+           The frame keeps its indices as long as the reader holds the file */
+        GifFrame& getFrame(size_t i);
+
+        /* LZW decodes frame into out, which must hold width*height indices, in row order even for interlaced frames. Only the counters of the frame are modified,
+           so this can be called from any thread while the reader is alive (as long as no other thread decodes the same frame) */
+        void decodeIndices(const GifFrame& frame, byte* out);
+
+        /* makes frame i use indices that were decoded earlier (width*height of them, in row order), for example by a cache,
+           so it is never LZW decoded. They are only read and must stay valid as long as the reader uses the frame */
+        void adoptIndices(size_t i, const byte* indices);
+
+        // counters of every frame added together
+        FrameCounters totalCounters() const;
+        // prints the counters of every frame and their totals
+        void printCounters(FILE* out) const;
 
         GifHeaderPacked unpackGifHeader(GifHeader& header);
         GifLocalImageDescriptorPacked unpackGifLocalImageDescriptor(GifLocalImageDescriptor& descriptor);
@@ -115,7 +216,7 @@ namespace GifFile {
         GifHeader gifHeader;
         GifHeaderPacked gifHeaderPacked;
 
-        GifGctColorEntry* globalColorTable;
+        GifGctColorEntry* globalColorTable = nullptr; // always holds 256 entries, unused ones are black. Owned by the reader
         uint32_t backgroundColorIndex;
 
     private:
@@ -131,9 +232,69 @@ namespace GifFile {
             return 0;
         }
 
-        FILE* m_file;
-        size_t m_filesize;
+        // copies a struct out of the mapped file and advances p. Returns false if the file ends before the struct does
+        template<typename T>
+        bool readStruct(const byte*& p, T& out) {
+            if ((size_t)(m_end - p) < sizeof(T))
+                return false;
+            memcpy(&out, p, sizeof(T));
+            p += sizeof(T);
+            return true;
+        }
+        // steps over a chain of data sub-blocks and its 0 terminator. Returns false if the file ends before the terminator
+        bool skipSubBlocks(const byte*& p);
+        // LZW decodes the image data of frame into its indices
+        void decodeFrame(GifFrame& frame);
+        // decodes every frame on the worker threads, rethrowing the error of the first frame that failed
+        void decodeFramesParallel(unsigned threadCount);
+        // moves the rows of a decoded interlaced frame from the order they were stored in to top to bottom order
+        void deinterlace(const GifFrame& frame, byte* indices);
+        // copies the animation settings of a Graphic Control Extension to frame
+        void applyGraphicControl(GifFrame& frame, GifGraphicControlExtension& extension);
+        // sets up frame from its Image Descriptor, and the row table if it is interlaced
+        void beginFrame(GifFrame& frame, GifLocalImageDescriptor& descriptor);
+
+        // what the push mode parser is waiting for
+        enum class StreamState {
+            Header, GlobalColorTable, Block, ExtensionLabel, GraphicControlSize, GraphicControl, ExtensionBlocks,
+            ImageDescriptor, LocalColorTable, LzwMinCodeSize, ImageBlocks, Ended, Failed
+        };
+        // everything feed() needs to continue where the previous call stopped
+        struct StreamParser {
+            StreamState state = StreamState::Header;
+            byte piece[sizeof(GifGctColorEntry) * 256]; // the fixed size structure being read, up to a whole color table
+            size_t pieceSize = 0, pieceNeeded = sizeof(GifHeader);
+            size_t subBlockLeft = 0; // data bytes left in the current sub-block, 0 if a length byte comes next
+            std::vector<byte> imageData; // sub-blocks of the current frame so far, copied to the arena once complete
+            GifFrame frame{};
+            uint64_t offset = 0; // bytes fed so far
+            uint64_t frameStart = 0; // offset where the extensions of the current frame began
+        };
+        // handles the fixed size structure collected in m_stream.piece and picks what comes next
+        void streamPiece();
+        // finishes the frame whose image data was collected, complete or not
+        void streamFrame();
+        // waits for needed bytes of a fixed size structure in state
+        void expectPiece(StreamState state, size_t needed) {
+            m_stream.state = state;
+            m_stream.pieceSize = 0;
+            m_stream.pieceNeeded = needed;
+        }
+
+        MappedFile m_file;
+        Arena m_arena; // the color table, index buffers and row tables of the current file
+        const byte* m_end; // end of the mapped file
         uint8_t m_verbose;
+
+        bool m_forceInterlace = false;
+        bool m_scanOnly = false; // set by scanFile() and scanMemory()
+        size_t m_frameLimit = 0;
+        /* for every height of an interlaced frame: the stored row that ends up at each row of the frame.
+           Built while scanning, so the decoding threads only read it */
+        std::vector<std::pair<word, const word*>> m_interlacedRows;
+        StreamParser m_stream;
+
+        unsigned m_decodeThreads = 1;
     };
 
 } // namespace GifFile
\ No newline at end of file
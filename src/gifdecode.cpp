@@ -0,0 +1,82 @@
+#include "gifdecode.h"
+#include <exception>
+
+namespace GifDecode {
+
+    bool Decoder::open(const uint8_t* data, size_t size, const DecodeOptions& options) {
+        // the reader is kept from file to file so its memory is reused
+        if (m_reader) {
+            m_reader->reset("<memory>");
+        } else {
+            m_reader.reset(new GifFile::GifFileReader("<memory>"));
+        }
+        m_reader->setFrameLimit(options.frameLimit);
+        // only the structure is read, decodeFrame() decodes into m_indices
+        if (m_reader->scanMemory(data, size)) {
+            m_reader->reset("<memory>");
+            return 1;
+        }
+
+        size_t screenWidth = m_reader->gifHeader.scrWidth, screenHeight = m_reader->gifHeader.scrHeight;
+        m_width = options.width ? options.width : screenWidth;
+        m_height = options.height ? options.height : screenHeight;
+        if (options.width && !options.height && screenWidth)
+            m_height = std::max<size_t>(1, (options.width * screenHeight + screenWidth / 2) / screenWidth);
+        else if (options.height && !options.width && screenHeight)
+            m_width = std::max<size_t>(1, (options.height * screenWidth + screenHeight / 2) / screenHeight);
+        size_t largestFrame = 0;
+        for (auto& frame : m_reader->frames) {
+            largestFrame = std::max(largestFrame, (size_t)frame.width * frame.height);
+        }
+        m_indices.assign(largestFrame, 0);
+        m_pixels.assign(m_width * m_height, 0);
+
+        // RGBA in memory order on little endian machines, opaque everywhere
+        GifRender::PixelLayout layout = {0, 8, 16, 0xFF000000};
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        layout = GifRender::PixelLayout{24, 16, 8, 0x000000FF};
+#endif
+        // the canvas is kept from file to file as well, resize() moves it to the new file and pixels
+        if (m_canvas)
+            m_canvas->resize(m_pixels.data(), m_width, m_width, m_height);
+        else
+            m_canvas.reset(new GifRender::Canvas(*m_reader, m_pixels.data(), m_width, layout, m_width, m_height));
+        m_next = 0;
+        return 0;
+    }
+
+    bool Decoder::frameInfo(size_t i, FrameInfo& info) {
+        if (i >= frameCount())
+            return 1;
+        const GifFile::GifFrame& frame = m_reader->frames[i];
+        info = FrameInfo{frame.left, frame.top, frame.width, frame.height, frame.delayTime,
+                         frame.disposalMethod, frame.hasTransparency, frame.isInterlaced};
+        return 0;
+    }
+
+    bool Decoder::decodeFrame(size_t i, uint8_t* rgba, size_t stride) {
+        if (i >= frameCount())
+            return 1;
+
+        // the canvas only moves forward, an earlier frame is rebuilt from the first one
+        if (i + 1 < m_next)
+            m_next = 0;
+        try {
+            for (; m_next <= i; m_next++) {
+                const GifFile::GifFrame& frame = m_reader->frames[m_next];
+                m_reader->decodeIndices(frame, m_indices.data());
+                m_canvas->drawFrame(m_next, m_indices.data());
+            }
+        } catch (const std::exception& e) {
+            printf("Could not decode frame %li: %s\n", m_next, e.what());
+            m_next = 0; // the canvas is incomplete, start over next time
+            return 1;
+        }
+
+        for (size_t y = 0; y < m_height; y++) {
+            memcpy(rgba + y * stride, m_pixels.data() + y * m_width, m_width * sizeof(uint32_t));
+        }
+        return 0;
+    }
+
+} // namespace GifDecode
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "gif.h"
+#include "render.h"
+#include <memory>
+
+
+/*
+ * libgifdecode: decodes GIF files held in memory into RGBA frames, without SDL.
+ * Every buffer is allocated by open(), decoding a frame never allocates. A decoder that is reused keeps its buffers,
+ * so once it has opened its largest file, opening another one does not allocate either.
+ */
+namespace GifDecode {
+    // Metadata of one frame, as stored in the file
+    struct FrameInfo {
+        uint16_t left, top, width, height; // frame rectangle on the canvas
+        uint32_t delayTime; // time on screen in milliseconds
+        uint8_t disposalMethod; // see GifFile::GifGraphicControlExtensionPacked
+        bool hasTransparency;
+        bool isInterlaced;
+    };
+
+    // How Decoder::open() prepares a file
+    struct DecodeOptions {
+        /* size of the decoded frames. 0 for both keeps the logical screen size, with only one of them set the other one
+           keeps the aspect ratio. A different size is sampled (nearest neighbor) while compositing */
+        size_t width = 0, height = 0;
+        // parse only this many frames, 0 parses the whole file. A thumbnail of frame i needs i + 1
+        size_t frameLimit = 0;
+    };
+
+    class Decoder {
+    public:
+        /*
+         * parses the GIF file in data and allocates everything needed to decode it. data is used in place,
+         * so it must stay alive and unchanged until the next open() or the decoder is destroyed.
+         * Opening files one after another with the same decoder reuses the memory of the previous ones.
+         * A thumbnail of frame i is open() with the thumbnail size and a frameLimit of i + 1, then decodeFrame(i):
+         * nothing after frame i is parsed or decoded, and only the thumbnail size canvas is allocated
+         * Returns: 0 on success, 1 on failure
+         */
+        bool open(const uint8_t* data, size_t size, const DecodeOptions& options = DecodeOptions());
+
+        // size of the decoded frames
+        size_t width() { return m_width; }
+        size_t height() { return m_height; }
+        size_t frameCount() { return m_reader ? m_reader->frames.size() : 0; }
+
+        /*
+         * fills info with the metadata of frame i. Frames are iterated with i from 0 to frameCount() - 1
+         * Returns: 0 on success, 1 if there is no frame i
+         */
+        bool frameInfo(size_t i, FrameInfo& info);
+
+        /*
+         * writes the canvas as it looks while frame i is shown (frame i composited over the frames before it)
+         * to rgba: 4 bytes per pixel in R, G, B, A order, stride bytes per row. Decoding the frames in order is fastest,
+         * going back to an earlier frame composites every frame from the first one again
+         * Returns: 0 on success, 1 on failure (no frame i, or corrupt image data)
+         */
+        bool decodeFrame(size_t i, uint8_t* rgba, size_t stride);
+
+    private:
+        std::unique_ptr<GifFile::GifFileReader> m_reader;
+        std::unique_ptr<GifRender::Canvas> m_canvas;
+        std::vector<uint32_t> m_pixels; // composited canvas, width()*height() pixels
+        std::vector<uint8_t> m_indices; // decoded indices of the current frame, sized for the largest frame
+        size_t m_width = 0, m_height = 0;
+        size_t m_next = 0; // next frame to composite on the canvas
+    };
+} // namespace GifDecode
@@ -0,0 +1,96 @@
+#include "gifwrite.h"
+#include <algorithm>
+
+namespace GifFile {
+
+    dword colorTableSizeBits(dword entryCount) {
+        dword bits = 0;
+        while (((dword)2 << bits) < entryCount && bits < 7)
+            bits++;
+        return bits;
+    }
+
+    void GifFileWriter::writeColorTable(const GifGctColorEntry* colorTable, dword entryCount, dword sizeBits) {
+        dword tableSize = (dword)2 << sizeBits;
+        entryCount = std::min(entryCount, tableSize);
+        m_data.insert(m_data.end(), (const byte*)colorTable, (const byte*)(colorTable + entryCount));
+        m_data.insert(m_data.end(), (tableSize - entryCount) * sizeof(GifGctColorEntry), 0);
+    }
+
+    void GifFileWriter::writeHeader(word width, word height, const GifGctColorEntry* colorTable, dword entryCount, byte bgColorIdx) {
+        GifHeader header;
+        memcpy(header.magic, "GIF", 3);
+        memcpy(header.version, "89a", 3);
+        header.scrWidth = width;
+        header.scrHeight = height;
+        dword sizeBits = colorTableSizeBits(entryCount);
+        // 8 bits of color resolution, the table is not sorted
+        header.packedByte = (byte)(0b01110000 | (colorTable ? 0b10000000 | sizeBits : 0));
+        header.bgColorIdx = bgColorIdx;
+        header.ratio = 0;
+        writeStruct(header);
+        if (colorTable)
+            writeColorTable(colorTable, entryCount, sizeBits);
+    }
+
+    void GifFileWriter::writeLoopExtension(word loopCount) {
+        static const byte application[] = {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1};
+        m_data.insert(m_data.end(), application, application + sizeof(application));
+        writeStruct(loopCount);
+        m_data.push_back(0);
+    }
+
+    void GifFileWriter::writeFrame(const GifFrame& frame, const byte* indices) {
+        // Graphic Control Extension
+        m_data.push_back(0x21);
+        m_data.push_back(0xF9);
+        m_data.push_back(sizeof(GifGraphicControlExtension));
+        GifGraphicControlExtension extension;
+        extension.packedByte = (byte)(((frame.disposalMethod & 0b111) << 2) | (frame.hasTransparency ? 1 : 0));
+        extension.delayTime = (word)std::min<dword>((frame.delayTime + 5) / 10, 0xFFFF);
+        extension.transparentIndex = frame.hasTransparency ? (byte)frame.transparencyIndex : 0;
+        writeStruct(extension);
+        m_data.push_back(0);
+
+        // Image Descriptor and Local Color Table
+        GifLocalImageDescriptor descriptor;
+        descriptor.id = 0x2C;
+        descriptor.left = frame.left;
+        descriptor.top = frame.top;
+        descriptor.width = frame.width;
+        descriptor.height = frame.height;
+        dword entryCount = frame.localColorTable ? frame.lctEntryCount : 256;
+        dword sizeBits = colorTableSizeBits(entryCount);
+        descriptor.packedByte = (byte)(frame.localColorTable ? 0b10000000 | sizeBits : 0);
+        writeStruct(descriptor);
+        if (frame.localColorTable)
+            writeColorTable(frame.localColorTable, entryCount, sizeBits);
+
+        // the minimum code size only has to fit the largest index, which is cheaper than fitting the whole color table
+        byte largest = 0;
+        size_t count = (size_t)frame.width * frame.height;
+        for (size_t i = 0; i < count; i++) {
+            largest = std::max(largest, indices[i]);
+        }
+        uint32_t minBitCount = 2;
+        while ((1U << minBitCount) <= largest)
+            minBitCount++;
+        m_data.push_back((byte)minBitCount);
+        GifLZW::LzwEncoder(minBitCount).encode(indices, count, m_data);
+    }
+
+    bool GifFileWriter::saveFile(const char* fileName) const {
+        FILE* out = fopen(fileName, "wb");
+        if (out == NULL) {
+            printf("Could not open %s for writing!\n", fileName);
+            return 1;
+        }
+        bool failed = fwrite(m_data.data(), 1, m_data.size(), out) != m_data.size();
+        if (fclose(out) != 0 || failed) {
+            printf("Could not write %s!\n", fileName);
+            return 1;
+        }
+        return 0;
+    }
+
+} // namespace GifFile
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "gif.h"
+#include "lzwencode.h"
+
+
+namespace GifFile {
+    /*
+     * Builds a GIF file in memory, block by block: the header with the Global Color Table first, then the frames,
+     * then the trailer. Uses the same structs as GifFileReader, so a frame read from one file can be written as it is.
+     */
+    class GifFileWriter {
+    public:
+        GifFileWriter() {}
+
+        // forgets everything written so far, keeping the memory
+        void reset() { m_data.clear(); }
+        // forgets everything written after the first size bytes
+        void truncate(size_t size) {
+            if (size < m_data.size())
+                m_data.resize(size);
+        }
+
+        /* writes the header and the Global Color Table. colorTable holds entryCount entries, it is padded with black
+           to the next power of two. A colorTable of nullptr writes no Global Color Table */
+        void writeHeader(word width, word height, const GifGctColorEntry* colorTable, dword entryCount, byte bgColorIdx);
+        // writes the NETSCAPE2.0 application extension that makes viewers loop the animation, 0 loops forever
+        void writeLoopExtension(word loopCount);
+        /*
+         * writes frame as a Graphic Control Extension, an Image Descriptor, its Local Color Table (if localColorTable is set)
+         * and the LZW compressed indices, width*height of them in row order. Uses delayTime (rounded to hundredths of a second),
+         * disposalMethod, hasTransparency, transparencyIndex, the rectangle and the color table of frame. Never interlaced
+         */
+        void writeFrame(const GifFrame& frame, const byte* indices);
+        // ends the file
+        void writeTrailer() { m_data.push_back(0x3B); }
+
+        const std::vector<byte>& data() const { return m_data; }
+
+        /*
+         * writes everything to fileName
+         * Returns: 0 on success, 1 on failure
+         */
+        bool saveFile(const char* fileName) const;
+
+    private:
+        template<typename T>
+        void writeStruct(const T& value) {
+            const byte* bytes = (const byte*)&value;
+            m_data.insert(m_data.end(), bytes, bytes + sizeof(T));
+        }
+        // writes entryCount entries of colorTable padded to 2^(sizeBits+1) entries
+        void writeColorTable(const GifGctColorEntry* colorTable, dword entryCount, dword sizeBits);
+
+        std::vector<byte> m_data;
+    };
+
+    // bits needed for a color table of entryCount entries, as stored in the size field of the packed bytes (size is 2^(bits+1))
+    dword colorTableSizeBits(dword entryCount);
+
+} // namespace GifFile
@@ -3,101 +3,151 @@
 
 namespace GifLZW
 {
-    LzwDecoder::LzwDecoder(uint8_t* data, uint32_t minimumBitCount) : m_minBitCount(minimumBitCount) {
-        m_reader = BitStreamReader(data);
+    LzwDecoder::LzwDecoder(const uint8_t* data, size_t size, uint32_t minimumBitCount) : m_minBitCount(minimumBitCount) {
+        // color indices are stored in bytes, so anything above 8 bits cannot be a valid GIF
+        if (m_minBitCount > 8) {
+            throw std::runtime_error("LZW minimum code size is bigger than 8 bits");
+        }
+        m_reader = BitStreamReader(data, size);
+
+        // the first values are the same as their keys, as they represent the final decoded indices.
+        // They never change, so they are only written once (the Clear Code and End Code get dummy entries).
+        for (uint32_t i = 0; i < (1U << m_minBitCount) + 2; i++) {
+            m_prefix[i] = 0;
+            m_suffix[i] = i;
+            m_first[i]  = i;
+            m_length[i] = 1;
+        }
         initDictionary();
     }
 
     void LzwDecoder::initDictionary() {
-        m_dict.clear();
-
+        // forgetting every entry after the Clear Code and End Code is enough to reset the dictionary
         m_currBitCount = m_minBitCount + 1; // add one since the Clear Code and End Code also need to be taken into account
         m_dictSize = (1L << m_minBitCount) + 2; // + 2 for Clear Code and End Code
-        for (size_t i = 0; i < m_dictSize; i++) {
-            // the first values are the same as their keys, as they represent the final decoded indices
-            m_dict.push_back(std::vector<uint32_t>(1, i)); // Key: LZW code, Value: code pattern assigned to said code      
-        }
-        m_clearCode = m_dictSize - 2;
-        m_endCode   = m_dictSize - 1;
-        
     }
 
 
-    uint32_t LzwDecoder::getNextValue() {
-        return m_reader.readBits(m_currBitCount);
+    size_t LzwDecoder::outputPattern(uint8_t* out, size_t pos, size_t outSize, uint32_t code) {
+        size_t length = m_length[code];
+        // a pattern running past the end of the output is cut off (its last indices are dropped)
+        while (pos + length > outSize) {
+            code = m_prefix[code];
+            length--;
+        }
+        // walk the prefix chain, which yields the pattern from its last index to its first
+        for (size_t i = pos + length; i-- > pos;) {
+            out[i] = m_suffix[code];
+            code = m_prefix[code];
+        }
+        return pos + length;
     }
 
 
-    // For more info, refer to https://giflib.sourceforge.net/whatsinagif/lzw_image_data.html
-    std::vector<uint32_t> LzwDecoder::decode(bool verbose) {
-        std::vector<uint32_t> indexVector;
+    size_t LzwDecoder::decode(uint8_t* out, size_t outSize, bool verbose) {
+        // the loop is picked once per stream: logging, or compiled for the minimum code size of the stream
+        typedef size_t (LzwDecoder::*DecodeFunction)(uint8_t*, size_t);
+        static const DecodeFunction decoders[9] = {
+            &LzwDecoder::decodeStream<false, 0>, &LzwDecoder::decodeStream<false, 0>, // 0 and 1 bits are not used by real files
+            &LzwDecoder::decodeStream<false, 2>, &LzwDecoder::decodeStream<false, 3>, &LzwDecoder::decodeStream<false, 4>,
+            &LzwDecoder::decodeStream<false, 5>, &LzwDecoder::decodeStream<false, 6>, &LzwDecoder::decodeStream<false, 7>,
+            &LzwDecoder::decodeStream<false, 8>
+        };
+        if (verbose)
+            return decodeStream<true, 0>(out, outSize);
+        return (this->*decoders[m_minBitCount])(out, outSize);
+    }
 
-        uint32_t code = getNextValue();
-        if (code == m_clearCode) {
-            initDictionary();
-            code = getNextValue(); // Get next code, as a clear code shouldn't appear in the code stream or else things will break
-        }
 
-        indexVector.push_back(code);
-        uint32_t lastCode = code;
-        if (verbose) { printf("Clear Code: %i, EOI Code: %i\n",m_clearCode,m_endCode); }
+    // For more info, refer to https://giflib.sourceforge.net/whatsinagif/lzw_image_data.html
+    template<bool Trace, uint32_t MinBits>
+    size_t LzwDecoder::decodeStream(uint8_t* out, size_t outSize) {
+        // with MinBits set, the Clear Code, End Code and the size of a fresh dictionary are compile time constants
+        const uint32_t minBitCount = MinBits ? MinBits : m_minBitCount;
+        const uint32_t clearCode = 1U << minBitCount; // resets the dictionary to its original values
+        const uint32_t endCode = clearCode + 1; // no more codes follow
+        const uint32_t rootCount = clearCode + 2; // size of the dictionary after a Clear Code
+        // kept in locals while decoding and written back at the end
+        uint32_t dictSize = m_dictSize, currBitCount = m_currBitCount;
+
+        size_t pos = 0;
+        uint32_t code;
+        uint32_t lastCode = NoCode;
+        // counted in locals so the loop does not store to memory for them
+        uint64_t codes = 0, clearCodes = 0, dictionaryResets = 0;
+        if constexpr (Trace) { printf("Clear Code: %i, EOI Code: %i\n",clearCode,endCode); }
 
         while (true) {
-            uint32_t dbg_bitOffset = m_reader.getBitOffset(), dbg_byteOffset = m_reader.getByteOffset();
-            code = getNextValue();
-            
-            if (verbose) {
-                printf("Code: %i, BitCount: %i, DictSize: %i, LastCode: %i, %i:%i\n",code, m_currBitCount, m_dictSize, lastCode, dbg_byteOffset, dbg_bitOffset); 
+            if constexpr (Trace) {
+                uint32_t dbg_bitOffset = m_reader.getBitOffset(), dbg_byteOffset = m_reader.getByteOffset();
+                code = m_reader.readBits(currBitCount);
+                printf("Code: %i, BitCount: %i, DictSize: %i, LastCode: %i, %i:%i\n",code, currBitCount, dictSize, lastCode, dbg_byteOffset, dbg_bitOffset); 
                 printf("%#08x %#08x\n", m_reader.getBytePtr()[dbg_byteOffset], m_reader.getBytePtr()[dbg_byteOffset+1]);    
+            } else {
+                code = m_reader.readBits(currBitCount);
             }
 
-            if (code == m_endCode)
+            // a stream that ends without an End Code is treated as if it had one
+            if (code == endCode || m_reader.overrun())
                 break;
-            if (code == m_clearCode) {
-                if (verbose) { printf("!!!! Reinitializing Dictionary !!!!\n"); }
-
-                initDictionary();
-                
-                /* code is a clear code so invalidate it
-                 * and since every code after a clearCode
-                 * is a uncompressed code just output it
-                 * to the index stream
-                 */ 
-                code = getNextValue();
-                indexVector.push_back(code);
-                lastCode = code;
+            codes++;
+            if (code == clearCode) {
+                if constexpr (Trace) { printf("!!!! Reinitializing Dictionary !!!!\n"); }
+
+                clearCodes++;
+                if (dictSize != rootCount)
+                    dictionaryResets++;
+                // forgetting every entry after the Clear Code and End Code is enough to reset the dictionary
+                dictSize = rootCount;
+                currBitCount = minBitCount + 1;
+                lastCode = NoCode;
                 continue;
             }
 
-
-            if(code < m_dictSize) { // if code in keys of m_dict
-                indexVector.insert(indexVector.end(), m_dict[code].begin(), m_dict[code].end());
-                uint32_t k = m_dict[code][0];
-
-                m_dict.push_back(m_dict[lastCode]);
-                m_dict[m_dictSize].push_back(k);
-                m_dictSize++;
-
-            } else {
-                if (code > m_dictSize) {
-                    throw std::runtime_error("LZW code is bigger that the current dictionary size");
+            /* every code after a clearCode (and the first code of the stream)
+             * is a uncompressed code so just output it
+             * to the index stream. No dictionary entry can be built yet
+             */
+            if (lastCode == NoCode) {
+                if (code > clearCode) {
+                    throw std::runtime_error("LZW stream does not start with an uncompressed index");
                 }
+                if (pos < outSize)
+                    out[pos++] = code;
+                lastCode = code;
+                continue;
+            }
+
+            if (code > dictSize) {
+                throw std::runtime_error("LZW code is bigger that the current dictionary size");
+            }
 
-                uint32_t k = m_dict[lastCode][0];
-                m_dict.push_back(m_dict[lastCode]);
-                m_dict[m_dictSize].push_back(k);
-                indexVector.insert(indexVector.end(), m_dict[m_dictSize].begin(), m_dict[m_dictSize].end());
-                m_dictSize++;
+            // the new entry is the last pattern plus the first index of the current one.
+            // If the code is not in the dictionary yet (code == dictSize), the current pattern starts with the last one.
+            uint32_t k = (code < dictSize) ? m_first[code] : m_first[lastCode];
+
+            // a full dictionary stays frozen until the encoder sends a Clear Code
+            if (dictSize < MaxDictSize) {
+                m_prefix[dictSize] = lastCode;
+                m_suffix[dictSize] = k;
+                m_first[dictSize]  = m_first[lastCode];
+                m_length[dictSize] = m_length[lastCode] + 1;
+                dictSize++;
             }
+            pos = outputPattern(out, pos, outSize, code);
 
 
-            if (m_dictSize == (1L << m_currBitCount) && m_currBitCount < 12) // < 12 Not sure if standards compliant but it's a hacky way to fix a bug
-                m_currBitCount++;
+            if (dictSize == (1U << currBitCount) && currBitCount < 12) // < 12 Not sure if standards compliant but it's a hacky way to fix a bug
+                currBitCount++;
    
             lastCode = code;
         }
-        
-        return indexVector;
+        m_dictSize = dictSize;
+        m_currBitCount = currBitCount;
+        m_counters.codes += codes;
+        m_counters.clearCodes += clearCodes;
+        m_counters.dictionaryResets += dictionaryResets;
+        return pos;
     }
 } // namespace GifLZW
 
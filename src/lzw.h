@@ -5,67 +5,144 @@
 #include <cstdio>
 #include <cmath>
 #include <vector>
+#include <string.h>
 
 
 namespace GifLZW {
+    /* Reads little endian bit fields (LSB first) from GIF image data.
+     * The data is read where it sits: a chain of sub-blocks, each one starting with its length byte
+     * and terminated by a block of length 0. The length bytes are skipped while reading.
+     * The bits are buffered in a 64 bit accumulator which is refilled a whole word at a time,
+     * so a code of up to 32 bits is extracted with a single mask and shift.
+     */
     class BitStreamReader {
     public:
         BitStreamReader() {}
-        BitStreamReader(uint8_t* bytes) : m_bytes(bytes) {}
+        // subBlocks points to the length byte of the first sub-block, size limits how far the reader may go
+        BitStreamReader(const uint8_t* subBlocks, size_t size) : m_bytes(subBlocks), m_cursor(subBlocks), m_blockEnd(subBlocks), m_end(subBlocks + size) {}
 
-        // returns a single bit as a uint32_t (0/1)
-        uint32_t readSingleBit() {
-            if (m_bitOffset > 7) {
-                m_bitOffset = 0;
-                m_byteOffset++;
+        // read n bits (maximum 32 bits). Reading past the end of the data yields zero bits and sets the overrun flag.
+        uint32_t readBits(uint32_t nBits) {
+            if (m_bitCount < nBits) {
+                refill();
+                if (m_bitCount < nBits) {
+                    // not enough bits left in the data, pad with zeros
+                    m_overrun = true;
+                    m_bitCount = nBits;
+                }
             }
-            auto ret = (m_bytes[m_byteOffset] & (1 << m_bitOffset)) >> m_bitOffset;
-            m_bitOffset++;
+            uint32_t ret = (uint32_t)(m_accumulator & ((1ULL << nBits) - 1));
+            m_accumulator >>= nBits;
+            m_bitCount -= nBits;
             return ret;
         }
 
-        // read n bits (maximum 32 bits)
-        uint32_t readBits(uint32_t nBits) {
-            //assert(nBits <= sizeof(uint32_t)*8)
-            uint32_t ret = 0;
-            for (size_t i = 0; i < nBits; ++i) {
-                ret |= readSingleBit() << i;
+        // true if a read went past the end of the data
+        bool overrun() { return m_overrun; }
+
+        // position of the next unread bit, relative to the first length byte
+        uint32_t getByteOffset() { return (uint32_t)(((m_cursor - m_bytes) * 8 - m_bitCount) / 8); }
+        uint32_t getBitOffset() { return (uint32_t)(((m_cursor - m_bytes) * 8 - m_bitCount) % 8); }
+        const uint8_t* getBytePtr() { return m_bytes; }
+
+    private:
+        // tops up the accumulator to more than 56 bits, or as many as the data has left
+        void refill() {
+            while (m_bitCount <= 56) {
+                if (m_blockEnd - m_cursor >= 8) {
+                    uint64_t word;
+                    memcpy(&word, m_cursor, sizeof(word));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+                    word = __builtin_bswap64(word);
+#endif
+                    // only whole bytes that fit in the accumulator are consumed, the rest of the word is dropped
+                    uint32_t consumed = (63 - m_bitCount) >> 3;
+                    m_accumulator |= word << m_bitCount;
+                    m_cursor += consumed;
+                    m_bitCount += consumed * 8;
+                    m_accumulator &= (1ULL << m_bitCount) - 1;
+                    return;
+                }
+                if (m_cursor == m_blockEnd) {
+                    if (!nextSubBlock())
+                        return;
+                    continue;
+                }
+                // close to the end of a sub-block, go byte by byte so the length byte is not read as data
+                m_accumulator |= (uint64_t)(*m_cursor++) << m_bitCount;
+                m_bitCount += 8;
             }
-            return ret;
         }
 
-        uint32_t getByteOffset() { return m_byteOffset; }
-        uint32_t getBitOffset() { return m_bitOffset; }
-        uint8_t* getBytePtr() { return m_bytes; }
+        // steps over the length byte of the next sub-block. Returns false once the terminator (or the end of the data) is hit
+        bool nextSubBlock() {
+            if (m_cursor >= m_end || *m_cursor == 0) {
+                m_end = m_blockEnd = m_cursor;
+                return false;
+            }
+            size_t length = *m_cursor++;
+            m_blockEnd = m_cursor + ((size_t)(m_end - m_cursor) < length ? (size_t)(m_end - m_cursor) : length);
+            return true;
+        }
 
-    private:
-        uint8_t* m_bytes;
-        uint32_t m_byteOffset = 0;
-        uint32_t m_bitOffset = 0;
+        const uint8_t* m_bytes = nullptr;
+        const uint8_t* m_cursor = nullptr;
+        const uint8_t* m_blockEnd = nullptr; // end of the current sub-block
+        const uint8_t* m_end = nullptr;
+        uint64_t m_accumulator = 0;
+        uint32_t m_bitCount = 0; // amount of valid bits in m_accumulator
+        bool m_overrun = false;
     };
 
 
 
+    // what a decoder went through, collected on every decode() whether it logs or not
+    struct LzwCounters {
+        uint64_t codes = 0; // codes read, including Clear Codes but not the End Code
+        uint64_t clearCodes = 0;
+        uint64_t dictionaryResets = 0; // Clear Codes that threw away entries (a leading Clear Code has nothing to forget)
+    };
+
     class LzwDecoder {
     public:
-        LzwDecoder(uint8_t* data, uint32_t minimumBitCount);
+        // GIF LZW codes are at most 12 bits wide, so the dictionary can never hold more than 4096 entries
+        static const uint32_t MaxDictSize = 4096;
+
+        // data points to the first image data sub-block (right after the LZW minimum code size byte)
+        LzwDecoder(const uint8_t* data, size_t size, uint32_t minimumBitCount);
         /*
-         * Decode GIF LZW compressed data
-         * Returns: vector of the decoded color table indices
+         * Decode GIF LZW compressed data into out, which holds outSize color table indices.
+         * Indices past outSize are dropped.
+         * Returns: amount of indices written to out
          */
-        std::vector<uint32_t> decode(bool verbose = false);
+        size_t decode(uint8_t* out, size_t outSize, bool verbose = false);
+
+        const LzwCounters& counters() const { return m_counters; }
     private:
-        uint32_t getNextValue();
+        // marks that the previous code was a Clear Code (or that nothing was decoded yet)
+        static const uint32_t NoCode = 0xFFFFFFFF;
+
+        /* the decoding loop. Tracing is a template parameter rather than a flag checked for every code,
+           so the loop used without logging contains no logging code at all.
+           MinBits compiles the loop for one minimum code size (2-8), 0 reads it from m_minBitCount */
+        template<bool Trace, uint32_t MinBits>
+        size_t decodeStream(uint8_t* out, size_t outSize);
+
         void initDictionary();
+        // writes the pattern assigned to code to out[pos...], returns the position after it
+        size_t outputPattern(uint8_t* out, size_t pos, size_t outSize, uint32_t code);
 
         BitStreamReader m_reader;
-        std::vector<std::vector<uint32_t>> m_dict;
-        // clear code: when this code appears in the stream, reset the dictionary to its original values
-        // end code: when this code appears, no more bytes need to be decoded
-        uint32_t m_clearCode, m_endCode;
+        /* The dictionary is stored as flat arrays. Every entry is its prefix entry plus one suffix index,
+           so a pattern is rebuilt by walking the prefix chain backwards. Adding an entry never allocates. */
+        uint16_t m_prefix[MaxDictSize];
+        uint8_t  m_suffix[MaxDictSize];
+        uint8_t  m_first[MaxDictSize];  // first index of the pattern, needed when a new entry is added
+        uint16_t m_length[MaxDictSize]; // length of the pattern
         uint32_t m_dictSize;
         // minBitCount: minimum bits required to represent a color index
         // currBitCount: since LZW codes can have a variable size, the currBitCount specifies that size
         uint32_t m_minBitCount, m_currBitCount;
+        LzwCounters m_counters;
     };
 } // namespace GifLZW
\ No newline at end of file
@@ -0,0 +1,73 @@
+#include "lzwencode.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace GifLZW
+{
+    LzwEncoder::LzwEncoder(uint32_t minimumBitCount) : m_minBitCount(minimumBitCount) {
+        // a minimum code size of 1 is not allowed by the specification, and indices are bytes
+        if (m_minBitCount < 2 || m_minBitCount > 8) {
+            throw std::runtime_error("LZW minimum code size must be between 2 and 8 bits");
+        }
+        initDictionary();
+    }
+
+    void LzwEncoder::initDictionary() {
+        // the single index patterns are their own codes and never need to be looked up, so only longer patterns are stored
+        std::fill(m_keys, m_keys + HashSize, EmptyKey);
+        m_currBitCount = m_minBitCount + 1;
+        m_dictSize = (1U << m_minBitCount) + 2; // + 2 for Clear Code and End Code
+    }
+
+
+    // For more info, refer to https://giflib.sourceforge.net/whatsinagif/lzw_image_data.html
+    void LzwEncoder::encode(const uint8_t* data, size_t count, std::vector<uint8_t>& out) {
+        const uint32_t clearCode = 1U << m_minBitCount;
+        const uint32_t endCode = clearCode + 1;
+        BitStreamWriter writer(out);
+
+        // the stream starts with a Clear Code, which decoders expect even though the dictionary is fresh
+        writer.writeBits(clearCode, m_currBitCount);
+        if (count == 0) {
+            writer.writeBits(endCode, m_currBitCount);
+            writer.finish();
+            return;
+        }
+
+        uint32_t pattern = data[0]; // code of the longest pattern matched so far
+        for (size_t i = 1; i < count; i++) {
+            uint32_t key = (pattern << 8) | data[i];
+            uint32_t slot = hashSlot(key);
+            while (m_keys[slot] != EmptyKey && m_keys[slot] != key) {
+                slot = (slot + 1) & (HashSize - 1);
+            }
+            if (m_keys[slot] == key) {
+                pattern = m_codes[slot];
+                continue;
+            }
+
+            // the pattern cannot grow any further: write it and remember it extended by the next index
+            writer.writeBits(pattern, m_currBitCount);
+            /* the decoder adds an entry one code later than the encoder, so the width grows once the entry about to be
+               added no longer fits, not once it has been added */
+            if (m_dictSize == (1U << m_currBitCount) && m_currBitCount < 12)
+                m_currBitCount++;
+            // like giflib, the dictionary is cleared one entry before it is full, which every decoder handles
+            if (m_dictSize < MaxDictSize - 1) {
+                m_keys[slot] = key;
+                m_codes[slot] = (uint16_t)m_dictSize++;
+            } else {
+                writer.writeBits(clearCode, m_currBitCount);
+                initDictionary();
+            }
+            pattern = data[i];
+        }
+        writer.writeBits(pattern, m_currBitCount);
+        if (m_dictSize == (1U << m_currBitCount) && m_currBitCount < 12)
+            m_currBitCount++;
+        writer.writeBits(endCode, m_currBitCount);
+        writer.finish();
+        initDictionary();
+    }
+
+} // namespace GifLZW
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+
+namespace GifLZW {
+    /* Writes little endian bit fields (LSB first) as GIF image data: a chain of sub-blocks of up to 255 bytes,
+     * each one starting with its length byte and terminated by a block of length 0. The counterpart of BitStreamReader.
+     */
+    class BitStreamWriter {
+    public:
+        // the sub-blocks are appended to out
+        BitStreamWriter(std::vector<uint8_t>& out) : m_out(out) {}
+
+        // write the low nBits bits of value (maximum 32 bits)
+        void writeBits(uint32_t value, uint32_t nBits) {
+            m_accumulator |= (uint64_t)value << m_bitCount;
+            m_bitCount += nBits;
+            while (m_bitCount >= 8) {
+                m_block[m_blockSize++] = (uint8_t)m_accumulator;
+                m_accumulator >>= 8;
+                m_bitCount -= 8;
+                if (m_blockSize == sizeof(m_block))
+                    flushBlock();
+            }
+        }
+
+        // pads the last byte with zero bits and writes the remaining sub-block and the terminator
+        void finish() {
+            if (m_bitCount > 0)
+                writeBits(0, 8 - m_bitCount);
+            if (m_blockSize > 0)
+                flushBlock();
+            m_out.push_back(0);
+        }
+
+    private:
+        void flushBlock() {
+            m_out.push_back((uint8_t)m_blockSize);
+            m_out.insert(m_out.end(), m_block, m_block + m_blockSize);
+            m_blockSize = 0;
+        }
+
+        std::vector<uint8_t>& m_out;
+        uint8_t m_block[255];
+        size_t m_blockSize = 0;
+        uint64_t m_accumulator = 0;
+        uint32_t m_bitCount = 0; // amount of valid bits in m_accumulator
+    };
+
+
+
+    class LzwEncoder {
+    public:
+        static const uint32_t MaxDictSize = 4096;
+
+        // minimumBitCount is the LZW minimum code size (2-8), every index passed to encode() must fit in it
+        LzwEncoder(uint32_t minimumBitCount);
+        /*
+         * GIF LZW compresses the count indices in data and appends them to out as image data sub-blocks,
+         * terminator included. The LZW minimum code size byte that precedes them is not written
+         */
+        void encode(const uint8_t* data, size_t count, std::vector<uint8_t>& out);
+
+    private:
+        /* The dictionary is a hash table from (prefix code, suffix index) to the code of that pattern, so extending
+           the current pattern by one index is a single lookup. Open addressing with linear probing, the table is
+           kept at most half full */
+        static const uint32_t HashBits = 13;
+        static const uint32_t HashSize = 1U << HashBits;
+        static const uint32_t EmptyKey = 0xFFFFFFFF;
+
+        static uint32_t hashSlot(uint32_t key) { return (key * 2654435761U) >> (32 - HashBits); }
+
+        void initDictionary();
+
+        uint32_t m_keys[HashSize]; // prefix << 8 | suffix, EmptyKey if the slot is free
+        uint16_t m_codes[HashSize];
+        uint32_t m_dictSize;
+        uint32_t m_minBitCount, m_currBitCount;
+    };
+} // namespace GifLZW
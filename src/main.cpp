@@ -1,52 +1,242 @@
 #include "gif.h"
+#include "render.h"
+#include "player.h"
+#include "wall.h"
+#include "framecache.h"
 #define SDL_MAIN_HANDLED
 #include <SDL2/SDL.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
 
-// Render methods will be implemented after main()
-void renderNormally(GifFile::GifFileReader& reader, SDL_Surface* drawCanvas, GifFile::GifFrame& currentFrame);
-void renderInterlaced(GifFile::GifFileReader& reader, SDL_Surface* drawCanvas, GifFile::GifFrame& currentFrame);
 
+// zoom level that fits the animation to the window, keeping its aspect ratio
+static const size_t ZoomFit = 0;
 
+// where a canvas of width x height at zoom (a whole factor or ZoomFit) goes in a window, centered
+static GifRender::Rect canvasArea(size_t zoom, size_t width, size_t height, size_t windowWidth, size_t windowHeight) {
+    size_t w = width * zoom, h = height * zoom;
+    if (zoom == ZoomFit) {
+        double scale = std::min((double)windowWidth / std::max<size_t>(width, 1), (double)windowHeight / std::max<size_t>(height, 1));
+        w = std::max<size_t>(1, std::min(windowWidth, (size_t)(width * scale + 0.5)));
+        h = std::max<size_t>(1, std::min(windowHeight, (size_t)(height * scale + 0.5)));
+    }
+    // a canvas larger than the window is cut off on the right and at the bottom
+    return GifRender::Rect{w < windowWidth ? (windowWidth - w) / 2 : 0, h < windowHeight ? (windowHeight - h) / 2 : 0, w, h};
+}
+
+// plays every file in paths at once, tiled in one window. Returns the exit code
+static int runWall(const std::vector<const char*>& paths, bool printStats) {
+    SDL_Init(SDL_INIT_EVERYTHING);
+    SDL_Rect bounds = {0, 0, 1920, 1080};
+    SDL_GetDisplayUsableBounds(0, &bounds);
+
+    uint64_t frequency = SDL_GetPerformanceFrequency();
+    GifPlayer::Wall wall(frequency);
+    if (wall.open(paths, bounds.w, bounds.h)) {
+        printf("None of the files could be read!\n");
+        SDL_Quit();
+        return EXIT_FAILURE;
+    }
+    printf("Playing %li files on a %lix%li wall. Esc quits.\n", (long)wall.tileCount(), (long)wall.width(), (long)wall.height());
+
+    SDL_Window *win = SDL_CreateWindow("GIF File Player",
+                                       SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+                                       wall.width(), wall.height(), SDL_WINDOW_SHOWN);
+    SDL_Surface *winSurface = SDL_GetWindowSurface(win);
+    SDL_Surface *drawCanvas = SDL_CreateRGBSurfaceWithFormat(0, wall.width(), wall.height(), 32, SDL_PIXELFORMAT_RGB888);
+    SDL_PixelFormat *canvasFormat = drawCanvas->format;
+
+    // frames are composited as soon as they are due, but the window is only presented on ticks of a 60 Hz display
+    const uint64_t tick = frequency / 60;
+    uint64_t start = SDL_GetPerformanceCounter();
+    wall.start((uint32_t *)drawCanvas->pixels, drawCanvas->pitch / sizeof(uint32_t),
+               GifRender::PixelLayout{canvasFormat->Rshift, canvasFormat->Gshift, canvasFormat->Bshift, canvasFormat->Amask}, start);
+
+    std::vector<GifRender::Rect> dirty;
+    std::vector<SDL_Rect> areas;
+    uint64_t presents = 0;
+    bool running = true;
+    bool fullPresent = true; // the window lost its content and needs the whole wall
+    auto handleEvent = [&](const SDL_Event& e) {
+        if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE))
+            running = false;
+        else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED)
+            fullPresent = true;
+    };
+    while (running) {
+        // input is read on every pass, so the window responds even while the wall is behind
+        SDL_Event e;
+        while (SDL_PollEvent(&e))
+            handleEvent(e);
+        if (!running)
+            break;
+
+        // sleep until the first tick at which a frame is due, but wake up for any input
+        uint64_t now = SDL_GetPerformanceCounter();
+        uint64_t due = wall.nextDeadline();
+        uint64_t wake = (due == UINT64_MAX) ? UINT64_MAX : start + (std::max(due, start) - start + tick - 1) / tick * tick;
+        if (fullPresent)
+            wake = now;
+        uint32_t waitTime = 0;
+        if (wake > now)
+            waitTime = (uint32_t)std::min<uint64_t>((wake - now) * 1000 / frequency, 1000);
+
+        if (waitTime > 0) {
+            if (SDL_WaitEventTimeout(&e, waitTime))
+                handleEvent(e);
+            continue;
+        }
+        // less than a millisecond left is not worth sleeping for
+        if (SDL_GetPerformanceCounter() < wake)
+            continue;
+
+        SDL_LockSurface(drawCanvas);
+        wall.update(SDL_GetPerformanceCounter());
+        SDL_UnlockSurface(drawCanvas);
+
+        // every tile that changed is presented in the same update
+        dirty.clear();
+        wall.takeDirtyRects(dirty);
+        if (fullPresent) {
+            dirty.assign(1, GifRender::Rect{0, 0, wall.width(), wall.height()});
+            fullPresent = false;
+        }
+        if (dirty.empty())
+            continue;
+        areas.clear();
+        for (auto& rect : dirty) {
+            SDL_Rect area = {(int)rect.x, (int)rect.y, (int)rect.w, (int)rect.h};
+            SDL_Rect destination = area;
+            SDL_BlitSurface(drawCanvas, &area, winSurface, &destination);
+            areas.push_back(area);
+        }
+        SDL_UpdateWindowSurfaceRects(win, areas.data(), (int)areas.size());
+        presents++;
+    }
+
+    if (printStats) {
+        wall.printStats(stdout);
+        printf("%llu presents in %.1f s\n", (unsigned long long)presents, (double)(SDL_GetPerformanceCounter() - start) / frequency);
+    }
+    SDL_FreeSurface(drawCanvas);
+    SDL_DestroyWindow(win);
+    SDL_Quit();
+    return EXIT_SUCCESS;
+}
 
 int main(int argc, const char *argv[]) {
 
-    if (argc < 2) {
-        printf("Syntax: reader.exe <file path> [verbose level 0-2 (1 - frames, 2 - LZW + frames)] [force interlace (i)]\n");
+    // options ("--name value") may appear anywhere, everything else is a positional argument
+    std::vector<const char*> args;
+    size_t decodeWindow = 4;
+    bool preload = false;
+    unsigned decodeThreads = 1;
+    size_t keyframeStride = 0;
+    bool printStats = false;
+    bool wallMode = false;
+    size_t zoom = 1;
+    const char* cacheDirectory = nullptr;
+    uint64_t cacheLimitMb = 1024;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            decodeWindow = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--keyframes") == 0 && i + 1 < argc) {
+            keyframeStride = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            printStats = true;
+        } else if (strcmp(argv[i], "--zoom") == 0 && i + 1 < argc) {
+            ++i;
+            // exactly one digit from 1 to 4, or fit (a 0 would also mean fit, so it is not accepted)
+            if (strcmp(argv[i], "fit") == 0) {
+                zoom = ZoomFit;
+            } else if (argv[i][0] >= '1' && argv[i][0] <= '4' && argv[i][1] == 0) {
+                zoom = argv[i][0] - '0';
+            } else {
+                printf("Unrecognised zoom '%s', use 1, 2, 3, 4 or fit\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+            cacheDirectory = argv[++i];
+        } else if (strcmp(argv[i], "--cache-size") == 0 && i + 1 < argc) {
+            cacheLimitMb = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--wall") == 0) {
+            wallMode = true;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            preload = true;
+            decodeThreads = strtoul(argv[++i], NULL, 10);
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+
+    if (args.size() < 2) {
+        printf("Syntax: reader.exe <file path, - for stdin> [verbose level 0-2 (1 - frames, 2 - LZW + frames)] [force interlace (i)] [--window <frames decoded ahead>] [--threads <preload with n threads, 0 = all cores>] [--keyframes <stride>] [--zoom <1-4|fit>] [--cache <directory> [--cache-size <MiB>]] [--stats]\n");
+        printf("        reader.exe --wall <file paths...> [--stats]\n");
         return EXIT_FAILURE;
     }
+    // every positional argument is a file on a wall
+    if (wallMode)
+        return runWall(std::vector<const char*>(args.begin() + 1, args.end()), printStats);
 
     uint8_t verboseMode = 0;
-    if (argc > 2) {
-        if (memcmp(argv[2], "1", 1) == 0)
+    if (args.size() > 2) {
+        if (memcmp(args[2], "1", 1) == 0)
             verboseMode = 1;
-        else if (memcmp(argv[2], "2", 1) == 0)
+        else if (memcmp(args[2], "2", 1) == 0)
             verboseMode = 2;
-        else if (memcmp(argv[2], "0", 1) == 0)
+        else if (memcmp(args[2], "0", 1) == 0)
             verboseMode = false;
         else {
-            printf("Unrecognised option '%c'\n", *argv[2]);
+            printf("Unrecognised option '%c'\n", *args[2]);
             return EXIT_FAILURE;
         }
     }
 
     uint8_t forceInterlace = false;
-    if (argc > 3) {
-        if (*argv[3] == 'i') {
+    if (args.size() > 3) {
+        if (*args[3] == 'i') {
             printf("Forcing interlace mode.\n");
             forceInterlace = true;
         } else {
-            printf("Unrecognised option '%c'\n", *argv[3]);
+            printf("Unrecognised option '%c'\n", *args[3]);
         }
     }
     
 
-    GifFile::GifFileReader reader(argv[1], verboseMode);
-    bool retVal = reader.readFile();
+    GifFile::GifFileReader reader(args[1], verboseMode);
+    reader.setForceInterlace(forceInterlace);
+    /* By default the file is only scanned and the frames are decoded during playback, so memory use does not depend
+       on the frame count. --threads decodes every frame up front instead */
+    reader.setDecodeThreads(decodeThreads);
+    bool retVal;
+    if (strcmp(args[1], "-") == 0) {
+        // a pipe cannot be mapped, so it is fed to the parser as it arrives
+#ifdef _WIN32
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+        retVal = preload ? reader.readStream(stdin) : reader.scanStream(stdin);
+    } else {
+        retVal = preload ? reader.readFile() : reader.scanFile();
+    }
     if (retVal != 0) {
         printf("Reader failed!\n");
         return EXIT_FAILURE;
     }
 
+    /* with a cache, a file played before gets all of its frames decoded from the cache file, and a new one is decoded once
+       into it. Playback then never decodes, the producer and seeking take the frames as they are */
+    GifCache::FrameCache cache(cacheDirectory ? cacheDirectory : "", cacheLimitMb * 1024 * 1024);
+    if (cacheDirectory && strcmp(args[1], "-") != 0) {
+        if (cache.load(reader) == 0)
+            printf("Frames loaded from the cache.\n");
+        else if (cache.store(reader) == 0 && cache.load(reader) == 0)
+            printf("Frames decoded into the cache.\n");
+        else
+            printf("Could not cache the frames, decoding them during playback.\n");
+    }
+
     printf("Frame Info :\n");
     for (size_t i = 0; i < reader.frames.size(); i++) {
         auto &frame = reader.frames[i];
@@ -58,137 +248,187 @@ int main(int argc, const char *argv[]) {
     }
 
     SDL_Init(SDL_INIT_EVERYTHING);
+    size_t screenWidth = reader.gifHeader.scrWidth, screenHeight = reader.gifHeader.scrHeight;
+    // fitting starts with the animation as large as the screen allows, any other zoom with a window just around it
+    SDL_Rect bounds = {0, 0, 1920, 1080};
+    SDL_GetDisplayUsableBounds(0, &bounds);
+    GifRender::Rect placement = canvasArea(zoom, screenWidth, screenHeight, bounds.w, bounds.h);
+    if (zoom != ZoomFit)
+        placement = GifRender::Rect{0, 0, placement.w, placement.h};
     SDL_Window *win = SDL_CreateWindow("GIF File Player",
                                        SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-                                       reader.gifHeader.scrWidth, reader.gifHeader.scrHeight,
-                                       SDL_WINDOW_SHOWN);
+                                       placement.w, placement.h,
+                                       SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    placement.x = placement.y = 0;
 
     SDL_Surface *winSurface = SDL_GetWindowSurface(win);
 
     /* A surface is used here in order to speed up rendering by directly drawing onto the surface.
-       Locking and Unlocking are expensive operations but still cheaper that SDL_RenderDrawPoint */
-    SDL_Surface *drawCanvas = SDL_CreateRGBSurfaceWithFormat(
-        0, reader.gifHeader.scrWidth, reader.gifHeader.scrHeight,
-        32, SDL_PIXELFORMAT_RGB888);
+       Locking and Unlocking are expensive operations but still cheaper that SDL_RenderDrawPoint.
+       It is as large as the animation is shown, the canvas scales while compositing so nothing is scaled when presenting */
+    SDL_Surface *drawCanvas = SDL_CreateRGBSurfaceWithFormat(0, placement.w, placement.h, 32, SDL_PIXELFORMAT_RGB888);
+
+    // composites the frames straight into the surface pixels. Colors are mapped once per color table, not per pixel
+    SDL_PixelFormat *canvasFormat = drawCanvas->format;
+    GifRender::Canvas canvas(reader, (uint32_t *)drawCanvas->pixels, drawCanvas->pitch / sizeof(uint32_t),
+                             GifRender::PixelLayout{canvasFormat->Rshift, canvasFormat->Gshift, canvasFormat->Bshift, canvasFormat->Amask},
+                             placement.w, placement.h);
 
-    auto backgroundColor = reader.globalColorTable[reader.backgroundColorIndex];
+    // a background thread decodes up to decodeWindow frames ahead, so the first frame shows up after a single decode
+    GifPlayer::Player player(reader, canvas, decodeWindow);
+    if (keyframeStride > 0) {
+        printf("Building keyframe index (every %li frames)...\n", keyframeStride);
+        player.buildKeyframes(keyframeStride);
+    }
+    printf("Controls: Space pause, Left/Right step, Home/End first/last frame, drag with the mouse to scrub, 1-4 zoom, F fit to window, Esc quit.\n");
+    player.start();
 
-    // NOTE: the structure of this "gameloop" has a bug. No event can be handled when an animation has started playing.
     bool running = true;
+    bool paused = false;
+    bool redraw = false; // the canvas changed outside of normal playback (seeking)
+    bool fullPresent = true; // the window lost its content and needs the whole canvas
+    // frames are due at absolute times on the high resolution clock, so playback does not drift however long it runs
+    GifPlayer::FrameScheduler scheduler(SDL_GetPerformanceFrequency());
+    scheduler.reset(SDL_GetPerformanceCounter());
+    auto currentDelay = [&]() {
+        size_t current = player.currentFrame();
+        return current == GifRender::Canvas::NoFrame ? 0 : GifPlayer::FrameScheduler::frameDelay(reader.frames[current].delayTime);
+    };
+    /* dragging the window edge sends a size change for every step, and a new canvas size builds the keyframes again. So the
+       canvas is only laid out once the size stopped changing for ResizeSettleMs, until then the old one is shown */
+    const uint64_t ResizeSettleMs = 150;
+    bool resizePending = false;
+    uint64_t resizeDue = 0; // on the high resolution clock
+    // places the canvas in the window after a resize or zoom change. The canvas only changes (and builds its tables) if its size does
+    auto layoutCanvas = [&]() {
+        resizePending = false;
+        winSurface = SDL_GetWindowSurface(win);
+        GifRender::Rect area = canvasArea(zoom, screenWidth, screenHeight, winSurface->w, winSurface->h);
+        if (area.w != placement.w || area.h != placement.h) {
+            SDL_FreeSurface(drawCanvas);
+            drawCanvas = SDL_CreateRGBSurfaceWithFormat(0, area.w, area.h, 32, SDL_PIXELFORMAT_RGB888);
+            canvas.resize((uint32_t *)drawCanvas->pixels, drawCanvas->pitch / sizeof(uint32_t), area.w, area.h);
+            player.canvasResized();
+        }
+        placement = area;
+        SDL_FillRect(winSurface, NULL, 0); // the window around the canvas stays black
+        fullPresent = redraw = true;
+    };
+    auto handleEvent = [&](const SDL_Event& e) {
+        if (e.type == SDL_QUIT) {
+            running = false;
+        } else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_EXPOSED) {
+            fullPresent = redraw = true;
+        } else if (e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED) {
+            // the old surface is gone, the canvas is shown on the new one where it was
+            winSurface = SDL_GetWindowSurface(win);
+            SDL_FillRect(winSurface, NULL, 0);
+            fullPresent = redraw = true;
+            resizePending = true;
+            resizeDue = SDL_GetPerformanceCounter() + ResizeSettleMs * SDL_GetPerformanceFrequency() / 1000;
+        } else if (e.type == SDL_KEYDOWN) {
+            switch (e.key.keysym.sym) {
+                case SDLK_ESCAPE: running = false; break;
+                case SDLK_SPACE:
+                    paused = !paused;
+                    // the time spent paused does not count, the current frame gets its whole delay again
+                    if (!paused)
+                        scheduler.reset(SDL_GetPerformanceCounter(), currentDelay());
+                    break;
+                case SDLK_LEFT:  paused = true; player.step(-1); redraw = true; break;
+                case SDLK_RIGHT: paused = true; player.step(1); redraw = true; break;
+                case SDLK_HOME:  player.seek(0); redraw = true; break;
+                case SDLK_END:   player.seek(reader.frames.size() - 1); redraw = true; break;
+                case SDLK_1: case SDLK_2: case SDLK_3: case SDLK_4:
+                    // the window follows a whole zoom, which sends a size change; the layout is redone right away in case it does not
+                    zoom = e.key.keysym.sym - SDLK_0;
+                    SDL_SetWindowSize(win, (int)(screenWidth * zoom), (int)(screenHeight * zoom));
+                    layoutCanvas();
+                    break;
+                case SDLK_f: zoom = ZoomFit; layoutCanvas(); break;
+            }
+        } else if ((e.type == SDL_MOUSEBUTTONDOWN && e.button.button == SDL_BUTTON_LEFT) ||
+                   (e.type == SDL_MOUSEMOTION && (e.motion.state & SDL_BUTTON_LMASK))) {
+            int x = (e.type == SDL_MOUSEMOTION) ? e.motion.x : e.button.x;
+            // the position along the canvas, which may not fill the window. scrub() clamps clicks beside it to either end
+            player.scrub((double)(x - (int)placement.x) / std::max(1, (int)placement.w - 1));
+            redraw = true;
+        }
+    };
     while (running) {
+        // input is read on every pass, so the window responds even while playback is behind or waits for the decoder
         SDL_Event e;
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_QUIT)
-                running = false;
-        }
+        while (SDL_PollEvent(&e))
+            handleEvent(e);
+        if (!running)
+            break;
+        if (resizePending && SDL_GetPerformanceCounter() >= resizeDue)
+            layoutCanvas();
 
-        // Equivilant to SDL_RenderClear but for surfaces
-        SDL_FillRect(drawCanvas, NULL, SDL_MapRGB(drawCanvas->format, backgroundColor.r, backgroundColor.g, backgroundColor.b));
-
-        for (size_t i = 0; i < reader.frames.size(); i++) {
-            auto &currentFrame = reader.frames[i];
-            if (currentFrame.clearBuffer) {
-                // must clear old loop
-                if (i == 0) {
-                    SDL_FillRect(drawCanvas, NULL, SDL_MapRGB(drawCanvas->format, backgroundColor.r, backgroundColor.g, backgroundColor.b));
-                }
-
-                // Small optimization to spend less time rendering, excuse the weird indentation
-                else if (currentFrame.width != reader.frames[i - 1].width && currentFrame.height != reader.frames[i - 1].height &&
-                         currentFrame.left != reader.frames[i - 1].left && currentFrame.top != reader.frames[i - 1].top) {
-                        
-                    SDL_FillRect(drawCanvas, NULL, SDL_MapRGB(drawCanvas->format, backgroundColor.r, backgroundColor.g, backgroundColor.b));
-                }
+        if (!redraw) {
+            // sleep until the next frame is due, but wake up for any input
+            uint64_t now = SDL_GetPerformanceCounter();
+            uint32_t waitTime = paused ? 100 : scheduler.millisecondsLeft(now);
+            if (resizePending)
+                waitTime = std::min<uint32_t>(waitTime, (uint32_t)((resizeDue - std::min(now, resizeDue)) * 1000 / SDL_GetPerformanceFrequency()));
+            if (waitTime > 0) {
+                if (SDL_WaitEventTimeout(&e, waitTime))
+                    handleEvent(e);
+                continue;
             }
+        }
 
-            uint64_t frameStart = SDL_GetTicks64();
+        bool scheduled = !redraw; // a frame of normal playback, not one drawn by seeking or exposing
+        if (scheduled) {
+            // less than a millisecond left is not worth sleeping for
+            if (paused || SDL_GetPerformanceCounter() < scheduler.deadline())
+                continue;
             SDL_LockSurface(drawCanvas); // Take control of the canvas' buffer
-
-            if (currentFrame.isInterlaced || forceInterlace)
-                renderInterlaced(reader, drawCanvas, currentFrame);
-            else
-                renderNormally(reader, drawCanvas, currentFrame);
-
-
+            bool shown = player.advance();
             SDL_UnlockSurface(drawCanvas);
-            SDL_BlitSurface(drawCanvas, NULL, winSurface, NULL);
-            SDL_UpdateWindowSurface(win);
+            if (!shown) {
+                if (player.failed())
+                    running = false;
+                SDL_Delay(1); // next frame is not decoded yet, input is still read on the next pass
+                continue;
+            }
+            // behind schedule: keep compositing without presenting until the frame on the canvas is the one due now
+            if (!scheduler.frameComposited(SDL_GetPerformanceCounter(), currentDelay()))
+                continue;
+        } else if (!paused) {
+            // seeking shows a frame out of order, it stays for its whole delay from now
+            scheduler.reset(SDL_GetPerformanceCounter(), currentDelay());
+        }
+        redraw = false;
 
-            // account for frametime. SDL_Delay hangs when a negative value is given due to an underflow so a ternary expression is used.
-            uint64_t frameTime = SDL_GetTicks64() - frameStart;
-            SDL_Delay(currentFrame.delayTime - ((frameTime <= currentFrame.delayTime) ? frameTime : 0));
+        // only copy and present the part of the canvas that changed
+        GifRender::Rect dirty = canvas.takeDirtyRect();
+        if (fullPresent)
+            dirty = GifRender::Rect{0, 0, canvas.width(), canvas.height()};
+        if (!dirty.empty()) {
+            SDL_Rect area = {(int)dirty.x, (int)dirty.y, (int)dirty.w, (int)dirty.h};
+            // SDL_BlitSurface clips the destination rectangle in place
+            SDL_Rect destination = {(int)(placement.x + dirty.x), (int)(placement.y + dirty.y), area.w, area.h};
+            SDL_BlitSurface(drawCanvas, &area, winSurface, &destination);
+            if (fullPresent)
+                SDL_UpdateWindowSurface(win);
+            else
+                SDL_UpdateWindowSurfaceRects(win, &destination, 1);
         }
+        fullPresent = false;
+        if (scheduled)
+            scheduler.framePresented(SDL_GetPerformanceCounter());
     }
 
+    // the decoding thread also updates the counters, so it has to be stopped before they are read
+    player.stop();
+    if (printStats) {
+        reader.printCounters(stdout);
+        scheduler.printStats(stdout);
+    }
+
+    SDL_FreeSurface(drawCanvas);
     SDL_DestroyWindow(win);
     SDL_Quit();
     return EXIT_SUCCESS;
 }
-
-void renderNormally(GifFile::GifFileReader& reader, SDL_Surface* drawCanvas, GifFile::GifFrame& currentFrame) {
-    uint32_t *pixelBuffer = (uint32_t *)(drawCanvas->pixels);
-    auto &indices = currentFrame.indices;
-    for (size_t y = 0; y < currentFrame.height; y++) {
-        for (size_t x = 0; x < currentFrame.width; x++) {
-            if (indices[y * currentFrame.width + x] == currentFrame.transparencyIndex && currentFrame.hasTransparency)
-                continue;
-
-            auto pixel = reader.globalColorTable[indices[y * currentFrame.width + x]];
-            pixelBuffer[(currentFrame.top + y) * reader.gifHeader.scrWidth + (x + currentFrame.left)] = SDL_MapRGB(
-                drawCanvas->format,
-                pixel.r, pixel.g, pixel.b);
-        }
-    }
-}
-void renderInterlaced(GifFile::GifFileReader& reader, SDL_Surface* drawCanvas, GifFile::GifFrame& currentFrame) {
-    uint32_t *pixelBuffer = (uint32_t *)(drawCanvas->pixels);
-    auto &indices = currentFrame.indices;
-    uint32_t currentLine = 0;
-    // Pass 0
-    for (size_t y = 0; y < currentFrame.height / 8; y++) {
-        for (size_t x = 0; x < currentFrame.width; x++) {
-            auto pixel = reader.globalColorTable[indices[(currentLine) * currentFrame.width + x]];
-            pixelBuffer[(currentFrame.top + y*8) * reader.gifHeader.scrWidth + (x + currentFrame.left)] = SDL_MapRGB(
-                drawCanvas->format,
-                pixel.r, pixel.g, pixel.b);
-        }
-        currentLine++;
-    }
-    currentLine+=3; // 3 is the magic number. No idea what it means, but it workded for me.
-
-    // Pass 1
-    for (size_t y = 4; y < currentFrame.height / 8; y++) {
-        for (size_t x = 0; x < currentFrame.width; x++) {
-            auto pixel = reader.globalColorTable[indices[(currentLine) * currentFrame.width + x]];
-            pixelBuffer[(currentFrame.top + y*8) * reader.gifHeader.scrWidth + (x + currentFrame.left)] = SDL_MapRGB(
-                drawCanvas->format,
-                pixel.r, pixel.g, pixel.b);
-        }
-        currentLine++;  
-    }
-    currentLine+=3;
-    
-    // Pass 2
-    for (size_t y = 2; y < currentFrame.height / 4; y++) {
-        for (size_t x = 0; x < currentFrame.width; x++) {
-            auto pixel = reader.globalColorTable[indices[(currentLine) * currentFrame.width + x]];
-            pixelBuffer[(currentFrame.top + y*4) * reader.gifHeader.scrWidth + (x + currentFrame.left)] = SDL_MapRGB(
-                drawCanvas->format,
-                pixel.r, pixel.g, pixel.b);
-        }
-        currentLine++;
-    }
-    currentLine+=3;
-    
-    // Pass 3
-    for (size_t y = 1; y < currentFrame.height / 2; y++) {
-        for (size_t x = 0; x < currentFrame.width; x++) {
-            auto pixel = reader.globalColorTable[indices[(currentLine) * currentFrame.width + x]];
-            pixelBuffer[(currentFrame.top + y*2) * reader.gifHeader.scrWidth + (x + currentFrame.left)] = SDL_MapRGB(
-                drawCanvas->format,
-                pixel.r, pixel.g, pixel.b);
-        }
-        currentLine++;
-    }
-    currentLine+=3;
-}
\ No newline at end of file
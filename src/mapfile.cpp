@@ -0,0 +1,90 @@
+#include "mapfile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace GifFile {
+
+#ifdef _WIN32
+    bool MappedFile::open(const char* fileName) {
+        close();
+        HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return 1;
+
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return 1;
+        }
+
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL) {
+            CloseHandle(file);
+            return 1;
+        }
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view == NULL) {
+            CloseHandle(mapping);
+            CloseHandle(file);
+            return 1;
+        }
+
+        m_file = file;
+        m_mapping = mapping;
+        m_data = (const uint8_t*)view;
+        m_size = (size_t)size.QuadPart;
+        return 0;
+    }
+
+    void MappedFile::close() {
+        if (m_data)
+            UnmapViewOfFile(m_data);
+        if (m_mapping)
+            CloseHandle(m_mapping);
+        if (m_file)
+            CloseHandle(m_file);
+        m_data = nullptr;
+        m_mapping = m_file = nullptr;
+        m_size = 0;
+    }
+#else
+    bool MappedFile::open(const char* fileName) {
+        close();
+        int fd = ::open(fileName, O_RDONLY);
+        if (fd < 0)
+            return 1;
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return 1;
+        }
+
+        void* view = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // the mapping stays valid after the descriptor is closed
+        if (view == MAP_FAILED)
+            return 1;
+
+        // the parser walks the file front to back
+        madvise(view, st.st_size, MADV_SEQUENTIAL);
+        m_data = (const uint8_t*)view;
+        m_size = (size_t)st.st_size;
+        return 0;
+    }
+
+    void MappedFile::close() {
+        if (m_data)
+            munmap((void*)m_data, m_size);
+        m_data = nullptr;
+        m_size = 0;
+    }
+#endif
+
+} // namespace GifFile
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+namespace GifFile {
+    // Read-only memory mapping of a whole file. The mapping is released when the object is destroyed or closed.
+    class MappedFile {
+    public:
+        MappedFile() {}
+        ~MappedFile() { close(); }
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        /*
+         * maps fileName into memory, closing any previous mapping
+         * Returns: 0 on success, 1 on failure
+         */
+        bool open(const char* fileName);
+        void close();
+
+        const uint8_t* data() { return m_data; }
+        size_t size() { return m_size; }
+
+    private:
+        const uint8_t* m_data = nullptr;
+        size_t m_size = 0;
+#ifdef _WIN32
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+} // namespace GifFile
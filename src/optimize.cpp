@@ -0,0 +1,319 @@
+#include "optimize.h"
+#include <unordered_map>
+#include <exception>
+
+namespace GifOptimize {
+    using GifFile::byte;
+    using GifFile::GifGctColorEntry;
+    using GifRender::Rect;
+
+    // a frame is only written once the next one is known, as that one may just add its delay to it
+    struct PendingFrame {
+        GifFile::GifFrame frame{};
+        std::vector<byte> indices;
+        std::vector<GifGctColorEntry> colorTable; // Local Color Table, empty if the frame uses the Global Color Table
+    };
+
+    // canvas pixels are composited with the layout {0, 8, 16, 0}, so a pixel is the color itself
+    static const GifRender::PixelLayout CanvasLayout = {0, 8, 16, 0};
+    // never a canvas pixel, the top byte of those is always 0
+    static const uint32_t NoPixel = 0xFFFFFFFF;
+
+    static uint32_t toPixel(GifGctColorEntry color) {
+        return (uint32_t)color.r | ((uint32_t)color.g << 8) | ((uint32_t)color.b << 16);
+    }
+
+    static GifGctColorEntry toColor(uint32_t pixel) {
+        return GifGctColorEntry{(byte)pixel, (byte)(pixel >> 8), (byte)(pixel >> 16)};
+    }
+
+    // smallest rectangle holding every pixel that differs between previous and current
+    static Rect changedRect(const uint32_t* previous, const uint32_t* current, size_t width, size_t height) {
+        size_t left = width, right = 0, top = height, bottom = 0;
+        for (size_t y = 0; y < height; y++) {
+            const uint32_t* a = previous + y * width;
+            const uint32_t* b = current + y * width;
+            size_t first = 0;
+            while (first < width && a[first] == b[first])
+                first++;
+            if (first == width)
+                continue;
+            size_t last = width - 1;
+            while (a[last] == b[last])
+                last--;
+            left = std::min(left, first);
+            right = std::max(right, last + 1);
+            top = std::min(top, y);
+            bottom = y + 1;
+        }
+        if (top == height)
+            return Rect{0, 0, 0, 0};
+        return Rect{left, top, right - left, bottom - top};
+    }
+
+    /*
+     * turns rect of current into the indices and color table of pending. Pixels equal in previous become transparent,
+     * a previous of nullptr writes every pixel.
+     * Returns: 0 on success, 1 if the rectangle needs more colors than a color table holds
+     */
+    static bool buildFrame(PendingFrame& pending, const uint32_t* current, const uint32_t* previous, size_t width, Rect rect,
+                           const std::unordered_map<uint32_t, byte>& gctIndex, size_t gctEntryCount) {
+        // the colors of the rectangle, in the order they first appear
+        std::vector<uint32_t> colors;
+        std::unordered_map<uint32_t, uint32_t> colorSlot;
+        bool needsTransparency = false;
+        uint32_t lastPixel = NoPixel;
+        for (size_t y = rect.y; y < rect.y + rect.h; y++) {
+            for (size_t x = rect.x; x < rect.x + rect.w; x++) {
+                uint32_t pixel = current[y * width + x];
+                if (previous && previous[y * width + x] == pixel) {
+                    needsTransparency = true;
+                } else if (pixel != lastPixel) {
+                    lastPixel = pixel;
+                    if (colorSlot.emplace(pixel, (uint32_t)colors.size()).second)
+                        colors.push_back(pixel);
+                }
+            }
+        }
+
+        // the Global Color Table is used if it has every color and an index left over for transparency
+        std::vector<byte> slotIndex(colors.size());
+        bool useGct = !gctIndex.empty();
+        bool used[256] = {};
+        for (size_t i = 0; i < colors.size() && useGct; i++) {
+            auto found = gctIndex.find(colors[i]);
+            useGct = found != gctIndex.end();
+            if (useGct) {
+                slotIndex[i] = found->second;
+                used[found->second] = true;
+            }
+        }
+        uint32_t transparentIndex = 0;
+        if (useGct && needsTransparency) {
+            while (transparentIndex < gctEntryCount && used[transparentIndex])
+                transparentIndex++;
+            useGct = transparentIndex < gctEntryCount;
+        }
+
+        pending.colorTable.clear();
+        if (!useGct) {
+            if (colors.size() + needsTransparency > 256)
+                return 1;
+            for (size_t i = 0; i < colors.size(); i++) {
+                pending.colorTable.push_back(toColor(colors[i]));
+                slotIndex[i] = (byte)i;
+            }
+            transparentIndex = (uint32_t)colors.size();
+            if (needsTransparency)
+                pending.colorTable.push_back(GifGctColorEntry{0, 0, 0});
+        }
+
+        pending.indices.resize(rect.w * rect.h);
+        byte* out = pending.indices.data();
+        // neighboring pixels are mostly the same color, so the last lookup is remembered
+        lastPixel = NoPixel;
+        byte lastIndex = 0;
+        for (size_t y = rect.y; y < rect.y + rect.h; y++) {
+            for (size_t x = rect.x; x < rect.x + rect.w; x++) {
+                uint32_t pixel = current[y * width + x];
+                if (previous && previous[y * width + x] == pixel) {
+                    *out++ = (byte)transparentIndex;
+                    continue;
+                }
+                if (pixel != lastPixel) {
+                    lastPixel = pixel;
+                    lastIndex = slotIndex[colorSlot[pixel]];
+                }
+                *out++ = lastIndex;
+            }
+        }
+
+        GifFile::GifFrame& frame = pending.frame;
+        frame.left = (GifFile::word)rect.x;
+        frame.top = (GifFile::word)rect.y;
+        frame.width = (GifFile::word)rect.w;
+        frame.height = (GifFile::word)rect.h;
+        frame.disposalMethod = 1; // do not dispose, the next frame is drawn over this one
+        frame.clearBuffer = false;
+        frame.hasTransparency = needsTransparency;
+        frame.transparencyIndex = needsTransparency ? transparentIndex : 0;
+        frame.isInterlaced = false;
+        frame.lctEntryCount = (GifFile::dword)pending.colorTable.size();
+        return 0;
+    }
+
+    static void writePending(GifFile::GifFileWriter& writer, PendingFrame& pending) {
+        pending.frame.localColorTable = pending.colorTable.empty() ? nullptr : pending.colorTable.data();
+        writer.writeFrame(pending.frame, pending.indices.data());
+    }
+
+    // makes pending frame as it is in the file: its rectangle, color table, transparency and disposal
+    static void copyFrame(PendingFrame& pending, const GifFile::GifFrame& frame, const byte* indices) {
+        pending.frame = frame;
+        pending.frame.isInterlaced = false; // the indices are decoded in row order
+        pending.indices.assign(indices, indices + (size_t)frame.width * frame.height);
+        pending.colorTable.clear();
+        if (frame.localColorTable)
+            pending.colorTable.assign(frame.localColorTable, frame.localColorTable + frame.lctEntryCount);
+    }
+
+    /* true if frame draws the same pixels over both canvases, which only differ where it is opaque. The restore of
+       disposal method 3 puts the canvas under the frame back, so then they may not differ under the frame at all */
+    static bool hidesDifferences(const uint32_t* a, const uint32_t* b, size_t width, size_t height, const GifFile::GifFrame& frame,
+                                 const byte* indices) {
+        for (size_t y = 0; y < height; y++) {
+            for (size_t x = 0; x < width; x++) {
+                if (a[y * width + x] == b[y * width + x])
+                    continue;
+                if (x < frame.left || y < frame.top || x >= (size_t)frame.left + frame.width || y >= (size_t)frame.top + frame.height ||
+                    frame.disposalMethod == 3)
+                    return false;
+                if (frame.hasTransparency && indices[(y - frame.top) * frame.width + (x - frame.left)] == frame.transparencyIndex)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    static void writeStart(GifFile::GifFileReader& reader, GifFile::GifFileWriter& writer, const GifGctColorEntry* gct, size_t gctEntryCount) {
+        writer.writeHeader(reader.gifHeader.scrWidth, reader.gifHeader.scrHeight, gct, (GifFile::dword)gctEntryCount, reader.gifHeader.bgColorIdx);
+        if (reader.frames.size() > 1)
+            writer.writeLoopExtension(0);
+    }
+
+    // writes every frame of reader as it is, for animations whose frames cannot all be cut down
+    static bool copyAnimation(GifFile::GifFileReader& reader, GifFile::GifFileWriter& writer, const GifGctColorEntry* gct, size_t gctEntryCount,
+                              std::vector<size_t>* outputFrames) {
+        writeStart(reader, writer, gct, gctEntryCount);
+        if (outputFrames)
+            outputFrames->clear();
+        PendingFrame copy;
+        std::vector<byte> indices;
+        for (size_t i = 0; i < reader.frames.size(); i++) {
+            const GifFile::GifFrame& frame = reader.frames[i];
+            indices.resize((size_t)frame.width * frame.height);
+            try {
+                reader.decodeIndices(frame, indices.data());
+            } catch (const std::exception& e) {
+                printf("Could not decode frame %li: %s\n", (long)i, e.what());
+                return 1;
+            }
+            copyFrame(copy, frame, indices.data());
+            writePending(writer, copy);
+            if (outputFrames)
+                outputFrames->push_back(i);
+        }
+        writer.writeTrailer();
+        return 0;
+    }
+
+    // bytes pending takes once written, scratch is only used to encode it
+    static size_t encodedSize(GifFile::GifFileWriter& scratch, PendingFrame& pending) {
+        scratch.reset();
+        writePending(scratch, pending);
+        return scratch.data().size();
+    }
+
+    bool optimize(GifFile::GifFileReader& reader, GifFile::GifFileWriter& writer, std::vector<size_t>* outputFrames) {
+        size_t width = reader.gifHeader.scrWidth, height = reader.gifHeader.scrHeight;
+        const GifGctColorEntry* gct = reader.gifHeaderPacked.gctFlag ? reader.globalColorTable : nullptr;
+        size_t gctEntryCount = gct ? std::min<size_t>(reader.gifHeaderPacked.gctEntryCount, 256) : 0;
+        // nothing of an empty screen can change, so there is nothing to cut down and no frame could carry the delays
+        if (width == 0 || height == 0)
+            return copyAnimation(reader, writer, gct, gctEntryCount, outputFrames);
+        size_t start = writer.data().size();
+        writeStart(reader, writer, gct, gctEntryCount);
+        if (outputFrames)
+            outputFrames->clear();
+
+        // the first index of every color, duplicates in the table are never used
+        std::unordered_map<uint32_t, byte> gctIndex;
+        for (size_t i = 0; i < gctEntryCount; i++) {
+            gctIndex.emplace(toPixel(gct[i]), (byte)i);
+        }
+
+        size_t largestFrame = 0;
+        for (auto& frame : reader.frames) {
+            largestFrame = std::max(largestFrame, (size_t)frame.width * frame.height);
+        }
+        std::vector<byte> indices(largestFrame);
+        // previous is what the output shows, base what reader draws the frame over (the frame before after its disposal)
+        std::vector<uint32_t> previous(width * height), current(width * height), base(width * height);
+        GifRender::Canvas canvas(reader, current.data(), width, CanvasLayout);
+
+        PendingFrame pending, opaque;
+        GifFile::GifFileWriter scratch;
+        size_t outputCount = 0;
+        bool pendingIsCopy = false; // pending is a frame of reader as it is, which disposes like it
+        size_t i = 0;
+        try {
+            for (; i < reader.frames.size(); i++) {
+                const GifFile::GifFrame& frame = reader.frames[i];
+                reader.decodeIndices(frame, indices.data());
+                if (i == 0)
+                    canvas.clear();
+                else
+                    canvas.dispose();
+                base = current;
+                if (pendingIsCopy)
+                    previous = base;
+                canvas.drawFrame(i, indices.data());
+
+                // the first frame covers the whole canvas, viewers do not agree on what is under it
+                const uint32_t* compareWith = i == 0 ? nullptr : previous.data();
+                Rect changed = i == 0 ? Rect{0, 0, width, height} : changedRect(previous.data(), current.data(), width, height);
+                // a copied frame that disposes is no longer on screen once its delay is over
+                bool canMerge = !pendingIsCopy || pending.frame.disposalMethod < 2;
+                if (changed.empty()) {
+                    if (canMerge && pending.frame.delayTime + frame.delayTime <= 0xFFFF * 10) {
+                        pending.frame.delayTime += frame.delayTime;
+                        if (outputFrames)
+                            outputFrames->push_back(outputCount - 1);
+                        continue;
+                    }
+                    // the delay no longer fits in one frame, so one pixel is drawn again to carry the rest
+                    changed = Rect{0, 0, 1, 1};
+                    compareWith = nullptr;
+                }
+
+                if (i > 0)
+                    writePending(writer, pending);
+                bool built = !buildFrame(pending, current.data(), compareWith, width, changed, gctIndex, gctEntryCount);
+                /* transparency pays off when the changes are scattered, but it also breaks up runs of color the LZW dictionary
+                   already knows, so the frame is encoded both ways and the smaller one is kept */
+                if (compareWith && !buildFrame(opaque, current.data(), nullptr, width, changed, gctIndex, gctEntryCount) &&
+                    (!built || encodedSize(scratch, opaque) < encodedSize(scratch, pending))) {
+                    std::swap(pending, opaque);
+                    built = true;
+                }
+                pendingIsCopy = !built;
+                if (!built) {
+                    /* the changes need more colors than a color table holds, which the frame itself never does. It is written
+                       as it is if the output under it matches what reader draws it over, else the whole animation is */
+                    if (!hidesDifferences(i == 0 ? base.data() : previous.data(), base.data(), width, height, frame, indices.data())) {
+                        printf("Frame %li changes more colors at once than a color table can hold, every frame is written as it is\n", (long)i);
+                        writer.truncate(start);
+                        return copyAnimation(reader, writer, gct, gctEntryCount, outputFrames);
+                    }
+                    copyFrame(pending, frame, indices.data());
+                }
+                pending.frame.delayTime = frame.delayTime;
+                if (outputFrames)
+                    outputFrames->push_back(outputCount);
+                outputCount++;
+
+                for (size_t y = changed.y; y < changed.y + changed.h; y++) {
+                    memcpy(previous.data() + y * width + changed.x, current.data() + y * width + changed.x, changed.w * sizeof(uint32_t));
+                }
+            }
+        } catch (const std::exception& e) {
+            printf("Could not decode frame %li: %s\n", (long)i, e.what());
+            return 1;
+        }
+        if (outputCount > 0)
+            writePending(writer, pending);
+        writer.writeTrailer();
+        return 0;
+    }
+
+} // namespace GifOptimize
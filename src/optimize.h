@@ -0,0 +1,23 @@
+#pragma once
+
+#include "gifwrite.h"
+#include "render.h"
+
+
+namespace GifOptimize {
+    /*
+     * Re-encodes the animation of reader into writer so that it composites to the same pixels with less data.
+     * Every frame is composited and compared with the canvas of the frame before it: only the rectangle that changed
+     * is written, pixels inside it that did not change become transparent, and a frame that changes nothing only
+     * adds its delay to the frame before it. The output frames never dispose, they are drawn over each other.
+     * The Global Color Table of reader is kept and used by every frame whose colors it holds, other frames get a
+     * Local Color Table of just the colors they need.
+     * reader may be in any decode mode (a scan is enough), the frames are decoded here one at a time.
+     * A frame whose changes need more than 256 colors is written as it is, with its own color table and disposal. If the
+     * output under it differs from what reader draws it over, every frame of reader is written as it is instead.
+     * So is every frame of a file whose logical screen is empty.
+     * outputFrames, if set, receives for every frame of reader the output frame that shows it.
+     * Returns: 0 on success, 1 on failure (corrupt image data)
+     */
+    bool optimize(GifFile::GifFileReader& reader, GifFile::GifFileWriter& writer, std::vector<size_t>* outputFrames = nullptr);
+} // namespace GifOptimize
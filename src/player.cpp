@@ -0,0 +1,241 @@
+#include "player.h"
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+
+namespace GifPlayer {
+
+    void FrameProducer::start(size_t firstFrame) {
+        stop();
+        m_queue.clear();
+        m_stop = false;
+        m_failed = false;
+        m_thread = std::thread(&FrameProducer::run, this, firstFrame);
+    }
+
+    void FrameProducer::stop() {
+        m_stop = true;
+        if (m_thread.joinable())
+            m_thread.join();
+    }
+
+    void FrameProducer::run(size_t firstFrame) {
+        auto& frames = m_reader.frames;
+        size_t i = firstFrame;
+        while (!m_stop && !frames.empty()) {
+            DecodedFrame* slot = m_queue.beginPush();
+            if (!slot) {
+                // the render thread is a full queue behind, wait for it to free a slot
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            GifFile::GifFrame& frame = frames[i];
+            slot->frameIndex = i;
+            if (frame.isDecoded) {
+                // decoded up front by readFile(), nothing to do
+                slot->indices = frame.indices;
+            } else {
+                // the slot keeps its buffer, so after the first loop no more memory is allocated
+                slot->storage.resize((size_t)frame.width * frame.height);
+                try {
+                    m_reader.decodeIndices(frame, slot->storage.data());
+                } catch (std::exception& e) {
+                    printf("Frame %li failed to decode: %s\n", i, e.what());
+                    m_failed = true;
+                    return;
+                }
+                slot->indices = slot->storage.data();
+            }
+            m_queue.endPush();
+
+            i = (i + 1) % frames.size();
+        }
+    }
+
+    void KeyframeIndex::build(GifFile::GifFileReader& reader, GifRender::Canvas& canvas, size_t stride) {
+        m_stride = stride;
+        m_snapshots.clear();
+        if (stride == 0)
+            return;
+
+        std::vector<GifFile::byte> scratch;
+        for (size_t i = 0; i < reader.frames.size(); i++) {
+            GifFile::GifFrame& frame = reader.frames[i];
+            const GifFile::byte* indices = frame.indices;
+            if (!frame.isDecoded) {
+                scratch.resize((size_t)frame.width * frame.height);
+                reader.decodeIndices(frame, scratch.data());
+                indices = scratch.data();
+            }
+            canvas.drawFrame(i, indices);
+
+            if (i % stride == 0) {
+                m_snapshots.emplace_back();
+                canvas.save(m_snapshots.back());
+            }
+        }
+    }
+
+    const GifRender::CanvasSnapshot* KeyframeIndex::nearest(size_t frame) {
+        if (m_stride == 0 || m_snapshots.empty())
+            return nullptr;
+        return &m_snapshots[std::min(frame / m_stride, m_snapshots.size() - 1)];
+    }
+
+
+    double PacingStats::jitterStddev() const {
+        if (presented == 0)
+            return 0;
+        double mean = jitterMean();
+        return std::sqrt(std::max(0.0, jitterSquareSum / presented - mean * mean));
+    }
+
+    void FrameScheduler::reset(uint64_t now, uint32_t delayMs) {
+        m_origin = now;
+        m_elapsedMs = delayMs;
+        m_deadline = m_origin + toTicks(m_elapsedMs);
+    }
+
+    uint32_t FrameScheduler::millisecondsLeft(uint64_t now) const {
+        if (now >= m_deadline)
+            return 0;
+        return (uint32_t)std::min<uint64_t>((m_deadline - now) * 1000 / m_ticksPerSecond, UINT32_MAX);
+    }
+
+    bool FrameScheduler::frameComposited(uint64_t now, uint32_t delayMs) {
+        // without this a frame with no delay would never move the deadline, and every one of them would be dropped
+        delayMs = frameDelay(delayMs);
+        m_lastDue = m_deadline;
+        m_elapsedMs += delayMs;
+        m_deadline = m_origin + toTicks(m_elapsedMs);
+        if (now < m_deadline)
+            return true;
+
+        if (now - m_deadline > toTicks(MaxLagMs)) {
+            // catching up would mean dropping frames for too long (the decoder stalled, or the machine was asleep)
+            m_stats.resyncs++;
+            reset(now, delayMs);
+            return true;
+        }
+        m_stats.dropped++;
+        return false;
+    }
+
+    void FrameScheduler::framePresented(uint64_t now) {
+        double lateMs = now > m_lastDue ? (double)(now - m_lastDue) * 1000 / m_ticksPerSecond : 0;
+        m_stats.presented++;
+        m_stats.jitterSum += lateMs;
+        m_stats.jitterSquareSum += lateMs * lateMs;
+        m_stats.jitterMax = std::max(m_stats.jitterMax, lateMs);
+    }
+
+    void FrameScheduler::printStats(FILE* out) const {
+        fprintf(out, "Pacing: %llu frames presented, %llu dropped, %llu resyncs. Lateness: mean %.3f ms, stddev %.3f ms, max %.3f ms\n",
+                (unsigned long long)m_stats.presented, (unsigned long long)m_stats.dropped, (unsigned long long)m_stats.resyncs,
+                m_stats.jitterMean(), m_stats.jitterStddev(), m_stats.jitterMax);
+    }
+
+
+    void Player::start() {
+        m_current = GifRender::Canvas::NoFrame;
+        m_producer.start(0);
+    }
+
+    bool Player::advance() {
+        DecodedFrame* decoded = m_producer.front();
+        if (!decoded)
+            return false;
+
+        m_canvas.drawFrame(decoded->frameIndex, decoded->indices);
+        m_current = decoded->frameIndex;
+        m_producer.pop(); // the indices are not needed anymore, let the decoder reuse the slot
+        return true;
+    }
+
+    void Player::drawDirectly(size_t i) {
+        GifFile::GifFrame& frame = m_reader.frames[i];
+        if (frame.isDecoded) {
+            m_canvas.drawFrame(i, frame.indices);
+            return;
+        }
+        m_scratch.resize((size_t)frame.width * frame.height);
+        m_reader.decodeIndices(frame, m_scratch.data());
+        m_canvas.drawFrame(i, m_scratch.data());
+    }
+
+    void Player::drawUpTo(size_t frame) {
+        // start from the closest known canvas: the current one if it is at or before the target, or a snapshot
+        size_t next = 0;
+        const GifRender::CanvasSnapshot* snapshot = m_keyframes.nearest(frame);
+        bool currentUsable = m_current != GifRender::Canvas::NoFrame && m_current <= frame;
+        if (snapshot && (!currentUsable || snapshot->frameIndex > m_current)) {
+            m_canvas.restore(*snapshot);
+            next = snapshot->frameIndex + 1;
+        } else if (currentUsable) {
+            next = m_current + 1;
+        }
+        for (size_t i = next; i <= frame; i++) {
+            drawDirectly(i);
+        }
+    }
+
+    void Player::seek(size_t frame) {
+        size_t frameCount = m_reader.frames.size();
+        if (frameCount == 0)
+            return;
+        frame = std::min(frame, frameCount - 1);
+
+        // frames already queued belong to the old position
+        m_producer.stop();
+        size_t previous = m_current;
+        try {
+            drawUpTo(frame);
+            m_current = frame;
+        } catch (std::exception& e) {
+            printf("Seeking to frame %li failed: %s\n", (long)frame, e.what());
+            // the canvas was left halfway, the frame shown before is composited again (it decoded before, so it does again)
+            m_current = GifRender::Canvas::NoFrame;
+            if (previous != GifRender::Canvas::NoFrame) {
+                try {
+                    drawUpTo(previous);
+                    m_current = previous;
+                } catch (std::exception&) {
+                }
+            }
+            if (m_current == GifRender::Canvas::NoFrame)
+                m_canvas.clear();
+        }
+        m_producer.start(m_current == GifRender::Canvas::NoFrame ? 0 : (m_current + 1) % frameCount);
+    }
+
+    void Player::step(long delta) {
+        long frameCount = (long)m_reader.frames.size();
+        if (frameCount == 0)
+            return;
+        long current = (m_current == GifRender::Canvas::NoFrame) ? -1 : (long)m_current;
+        seek((size_t)(((current + delta) % frameCount + frameCount) % frameCount));
+    }
+
+    void Player::scrub(double position) {
+        position = std::max(0.0, std::min(1.0, position));
+        seek((size_t)(position * (m_reader.frames.size() - 1) + 0.5));
+    }
+
+    void Player::canvasResized() {
+        m_producer.stop();
+        if (m_keyframes.stride() > 0)
+            m_keyframes.build(m_reader, m_canvas, m_keyframes.stride());
+
+        size_t current = m_current;
+        m_current = GifRender::Canvas::NoFrame;
+        if (current == GifRender::Canvas::NoFrame) {
+            // nothing was shown yet
+            m_canvas.clear();
+            m_producer.start(0);
+            return;
+        }
+        seek(current);
+    }
+
+} // namespace GifPlayer
@@ -0,0 +1,210 @@
+#pragma once
+
+#include "gif.h"
+#include "render.h"
+#include <atomic>
+#include <thread>
+
+
+namespace GifPlayer {
+    // A frame that is ready to be composited
+    struct DecodedFrame {
+        size_t frameIndex; // index into GifFileReader::frames
+        const GifFile::byte* indices; // storage.data(), or the reader's own indices if the frame was decoded up front
+        std::vector<GifFile::byte> storage;
+    };
+
+    /*
+     * Bounded single producer / single consumer queue. The slots are allocated once and handed back and forth
+     * through two counters, so neither side ever takes a lock.
+     */
+    class FrameQueue {
+    public:
+        FrameQueue(size_t capacity) : m_slots(capacity > 0 ? capacity : 1) {}
+
+        // producer: returns the slot to fill next, or nullptr if the queue is full
+        DecodedFrame* beginPush() {
+            size_t tail = m_tail.load(std::memory_order_relaxed);
+            if (tail - m_head.load(std::memory_order_acquire) == m_slots.size())
+                return nullptr;
+            return &m_slots[tail % m_slots.size()];
+        }
+        // producer: publishes the slot returned by beginPush()
+        void endPush() { m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        // consumer: returns the oldest frame, or nullptr if the queue is empty
+        DecodedFrame* front() {
+            size_t head = m_head.load(std::memory_order_relaxed);
+            if (head == m_tail.load(std::memory_order_acquire))
+                return nullptr;
+            return &m_slots[head % m_slots.size()];
+        }
+        // consumer: hands the frame returned by front() back to the producer
+        void pop() { m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+        // empties the queue. Only allowed while there is no producer running
+        void clear() { m_head.store(0); m_tail.store(0); }
+
+    private:
+        std::vector<DecodedFrame> m_slots;
+        std::atomic<size_t> m_head{0}; // next frame to pop
+        std::atomic<size_t> m_tail{0}; // next slot to push
+    };
+
+    /*
+     * Decodes the frames of a reader on a background thread, in playback order and looping forever,
+     * so the render thread only has to composite. The reader must stay alive while the producer runs.
+     */
+    class FrameProducer {
+    public:
+        FrameProducer(GifFile::GifFileReader& reader, size_t queueSize) : m_reader(reader), m_queue(queueSize) {}
+        ~FrameProducer() { stop(); }
+
+        // starts decoding at firstFrame, dropping anything still queued
+        void start(size_t firstFrame = 0);
+        // stops the decoding thread and waits for it
+        void stop();
+
+        // the next frame in playback order, or nullptr if it is not decoded yet
+        DecodedFrame* front() { return m_queue.front(); }
+        void pop() { m_queue.pop(); }
+
+        // true if a frame failed to decode. The producer stops at that frame
+        bool failed() { return m_failed.load(); }
+
+    private:
+        void run(size_t firstFrame);
+
+        GifFile::GifFileReader& m_reader;
+        FrameQueue m_queue;
+        std::thread m_thread;
+        std::atomic<bool> m_stop{false};
+        std::atomic<bool> m_failed{false};
+    };
+    /*
+     * Canvas snapshots taken after every stride-th frame. Any frame can then be shown by restoring the snapshot
+     * before it and compositing at most stride - 1 frames on top of it.
+     */
+    class KeyframeIndex {
+    public:
+        /* composites every frame of the reader once on canvas and keeps a snapshot after frames 0, stride, 2*stride...
+           The canvas content is left at the last frame. A stride of 0 drops the index */
+        void build(GifFile::GifFileReader& reader, GifRender::Canvas& canvas, size_t stride);
+
+        // the last snapshot taken at or before frame, nullptr if there is none
+        const GifRender::CanvasSnapshot* nearest(size_t frame);
+
+        size_t stride() { return m_stride; }
+        size_t snapshotCount() { return m_snapshots.size(); }
+
+    private:
+        size_t m_stride = 0;
+        std::vector<GifRender::CanvasSnapshot> m_snapshots;
+    };
+
+    // How well playback kept to the frame delays, see FrameScheduler
+    struct PacingStats {
+        uint64_t presented = 0; // frames shown on screen
+        uint64_t dropped = 0; // frames composited but never shown, because the frame after them was already due
+        uint64_t resyncs = 0; // times playback fell too far behind and started counting again from the current frame
+        // how late presented frames were, in milliseconds
+        double jitterSum = 0, jitterSquareSum = 0, jitterMax = 0;
+
+        double jitterMean() const { return presented ? jitterSum / presented : 0; }
+        double jitterStddev() const;
+    };
+
+    /*
+     * Decides when frames are due. Every deadline is the start time plus the delays of all frames so far, in ticks of a
+     * monotonic clock, so waking up late or a slow frame never moves the frames after it and rounding never adds up.
+     * When playback falls behind, frames whose successor is already due are composited but not presented until it
+     * has caught up again. The clock is passed in, so the scheduler does not depend on SDL.
+     */
+    class FrameScheduler {
+    public:
+        // ticksPerSecond: resolution of the clock that every now is read from
+        FrameScheduler(uint64_t ticksPerSecond) : m_ticksPerSecond(ticksPerSecond) {}
+
+        // forgets the old deadlines, the next frame is due delayMs after now. Used at the start and after pausing or seeking
+        void reset(uint64_t now, uint32_t delayMs = 0);
+
+        // when the next frame is due
+        uint64_t deadline() const { return m_deadline; }
+        // whole milliseconds left until the next frame is due, 0 once it is less than a millisecond away
+        uint32_t millisecondsLeft(uint64_t now) const;
+
+        /* the frame that was due at deadline() has been composited at now and stays on screen for delayMs (see frameDelay()).
+           Moves the deadline on and returns true if the frame should be presented, false if the next frame is due already
+           (the frame is dropped). Falling more than MaxLagMs behind starts over from now instead of dropping frames */
+        bool frameComposited(uint64_t now, uint32_t delayMs);
+        // records how late the frame accepted by frameComposited() was when it reached the screen at now
+        void framePresented(uint64_t now);
+
+        const PacingStats& stats() const { return m_stats; }
+        void printStats(FILE* out) const;
+
+        static const uint32_t MaxLagMs = 1000;
+
+        /* the delay a frame is actually shown for. Like browsers do, delays below MinDelayMs (0 or 1 hundredth of a second,
+           which many files use to mean "as fast as possible") become DefaultDelayMs */
+        static uint32_t frameDelay(uint32_t delayMs) { return delayMs < MinDelayMs ? DefaultDelayMs : delayMs; }
+        static const uint32_t MinDelayMs = 20;
+        static const uint32_t DefaultDelayMs = 100;
+
+    private:
+        uint64_t toTicks(uint64_t ms) const { return ms / 1000 * m_ticksPerSecond + ms % 1000 * m_ticksPerSecond / 1000; }
+
+        uint64_t m_ticksPerSecond;
+        uint64_t m_origin = 0; // time the delays are counted from
+        uint64_t m_elapsedMs = 0; // delays of every frame since m_origin
+        uint64_t m_deadline = 0; // m_origin + m_elapsedMs in ticks
+        uint64_t m_lastDue = 0; // deadline of the frame passed to frameComposited()
+        PacingStats m_stats;
+    };
+
+    /*
+     * Plays the frames of a reader on a canvas. Frames are decoded ahead by a FrameProducer, and any frame can be
+     * jumped to with seek(), step() or scrub(). Timing is left to the caller: advance() shows the next frame.
+     */
+    class Player {
+    public:
+        Player(GifFile::GifFileReader& reader, GifRender::Canvas& canvas, size_t decodeWindow) : m_reader(reader), m_canvas(canvas), m_producer(reader, decodeWindow) {}
+
+        // builds the keyframe index (see KeyframeIndex). Call before start()
+        void buildKeyframes(size_t stride) { m_keyframes.build(m_reader, m_canvas, stride); }
+
+        // shows nothing yet and begins decoding from frame 0
+        void start();
+        // composites the next frame in playback order. Returns false if it is not decoded yet
+        bool advance();
+        // stops the background decoding, start() or seek() resume it
+        void stop() { m_producer.stop(); }
+
+        // composites frame and continues playback after it. If a frame fails to decode, the current frame stays as it was
+        void seek(size_t frame);
+        // moves by delta frames, wrapping around at either end
+        void step(long delta);
+        // jumps to a position between 0 (first frame) and 1 (last frame)
+        void scrub(double position);
+        /* draws the current frame again after the canvas was resized (GifRender::Canvas::resize()) and continues
+           playback after it. The keyframes hold pixels of the old size, so they are built again */
+        void canvasResized();
+
+        // last frame composited on the canvas, GifRender::Canvas::NoFrame before the first one
+        size_t currentFrame() { return m_current; }
+        bool failed() { return m_producer.failed(); }
+
+    private:
+        // decodes frame i into the scratch buffer (or uses its indices if readFile() decoded it) and composites it
+        void drawDirectly(size_t i);
+        // composites frame from the closest canvas known, the current one or a keyframe. Throws if a frame fails to decode
+        void drawUpTo(size_t frame);
+
+        GifFile::GifFileReader& m_reader;
+        GifRender::Canvas& m_canvas;
+        FrameProducer m_producer;
+        KeyframeIndex m_keyframes;
+        size_t m_current = GifRender::Canvas::NoFrame;
+        std::vector<GifFile::byte> m_scratch;
+    };
+} // namespace GifPlayer
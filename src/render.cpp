@@ -0,0 +1,347 @@
+#include "render.h"
+#include <chrono>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GIF_RENDER_X86
+#include <immintrin.h>
+#endif
+
+namespace GifRender {
+
+    const uint32_t* PaletteLut::get(GifFile::GifFileReader& reader, const GifFile::GifFrame& frame) {
+        if (frame.localColorTable)
+            return get(frame.localColorTable, frame.lctEntryCount);
+        return get(reader.globalColorTable, 256);
+    }
+
+    const uint32_t* PaletteLut::get(const GifFile::GifGctColorEntry* colorTable, size_t entryCount) {
+        if (colorTable == m_source)
+            return m_colors;
+
+        for (size_t i = 0; i < 256; i++) {
+            m_colors[i] = mapColor(i < entryCount ? colorTable[i] : GifFile::GifGctColorEntry{0, 0, 0});
+        }
+        m_source = colorTable;
+        return m_colors;
+    }
+
+
+    static void compositeRowScalar(uint32_t* dst, const uint8_t* src, size_t count, const uint32_t* lut, uint32_t transparentIndex) {
+        for (size_t i = 0; i < count; i++) {
+            uint32_t index = src[i];
+            dst[i] = (index == transparentIndex) ? dst[i] : lut[index];
+        }
+    }
+
+    static void compositeRowScaledScalar(uint32_t* dst, const uint8_t* src, size_t count, size_t scale, const uint32_t* lut, uint32_t transparentIndex) {
+        for (size_t i = 0; i < count; i++, dst += scale) {
+            uint32_t index = src[i];
+            if (index != transparentIndex)
+                std::fill(dst, dst + scale, lut[index]);
+        }
+    }
+
+#ifdef GIF_RENDER_X86
+    // SSE2 has no gather, so the lookups are scalar but the transparency blend is done 4 pixels at a time
+    __attribute__((target("sse2")))
+    static void compositeRowSSE2(uint32_t* dst, const uint8_t* src, size_t count, const uint32_t* lut, uint32_t transparentIndex) {
+        const __m128i transparent = _mm_set1_epi32(transparentIndex);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i indices = _mm_setr_epi32(src[i], src[i + 1], src[i + 2], src[i + 3]);
+            __m128i colors  = _mm_setr_epi32(lut[src[i]], lut[src[i + 1]], lut[src[i + 2]], lut[src[i + 3]]);
+            __m128i keep    = _mm_cmpeq_epi32(indices, transparent);
+            __m128i old     = _mm_loadu_si128((const __m128i*)(dst + i));
+            _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(keep, old), _mm_andnot_si128(keep, colors)));
+        }
+        compositeRowScalar(dst + i, src + i, count - i, lut, transparentIndex);
+    }
+
+    // 8 pixels at a time: widen the indices, gather their colors and blend the transparent ones with the canvas
+    __attribute__((target("avx2")))
+    static void compositeRowAVX2(uint32_t* dst, const uint8_t* src, size_t count, const uint32_t* lut, uint32_t transparentIndex) {
+        const __m256i transparent = _mm256_set1_epi32(transparentIndex);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+            __m256i colors  = _mm256_i32gather_epi32((const int*)lut, indices, 4);
+            __m256i keep    = _mm256_cmpeq_epi32(indices, transparent);
+            __m256i old     = _mm256_loadu_si256((const __m256i*)(dst + i));
+            _mm256_storeu_si256((__m256i*)(dst + i), _mm256_blendv_epi8(colors, old, keep));
+        }
+        compositeRowScalar(dst + i, src + i, count - i, lut, transparentIndex);
+    }
+
+    // the largest scale with its own spread patterns, larger ones are filled by the scalar loop
+    static const size_t MaxVectorScale = 8;
+
+    /* 8 indices at a time: their colors are gathered and blended like an unscaled row, but each of the scale stores
+       first permutes the 8 colors so that every color is repeated scale times across the magnified row */
+    __attribute__((target("avx2")))
+    static void compositeRowScaledAVX2(uint32_t* dst, const uint8_t* src, size_t count, size_t scale, const uint32_t* lut, uint32_t transparentIndex) {
+        if (scale > MaxVectorScale) {
+            compositeRowScaledScalar(dst, src, count, scale, lut, transparentIndex);
+            return;
+        }
+        // lane e of the j-th store of a group shows source pixel (8*j + e) / scale
+        __m256i spread[MaxVectorScale];
+        for (size_t j = 0; j < scale; j++) {
+            alignas(32) int32_t lanes[8];
+            for (size_t e = 0; e < 8; e++)
+                lanes[e] = (int32_t)((8 * j + e) / scale);
+            spread[j] = _mm256_load_si256((const __m256i*)lanes);
+        }
+
+        const __m256i transparent = _mm256_set1_epi32(transparentIndex);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i indices = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+            __m256i colors  = _mm256_i32gather_epi32((const int*)lut, indices, 4);
+            __m256i keep    = _mm256_cmpeq_epi32(indices, transparent);
+            for (size_t j = 0; j < scale; j++, dst += 8) {
+                __m256i old = _mm256_loadu_si256((const __m256i*)dst);
+                _mm256_storeu_si256((__m256i*)dst, _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(colors, spread[j]), old,
+                                                                      _mm256_permutevar8x32_epi32(keep, spread[j])));
+            }
+        }
+        compositeRowScaledScalar(dst, src + i, count - i, scale, lut, transparentIndex);
+    }
+#endif
+
+    typedef void (*RowKernelFn)(uint32_t*, const uint8_t*, size_t, const uint32_t*, uint32_t);
+    typedef void (*ScaledRowKernelFn)(uint32_t*, const uint8_t*, size_t, size_t, const uint32_t*, uint32_t);
+
+    // falls back from kernel to one the CPU supports
+    static RowKernel supportedRowKernel(RowKernel kernel) {
+#ifdef GIF_RENDER_X86
+        __builtin_cpu_init();
+        bool hasAVX2 = __builtin_cpu_supports("avx2");
+        bool hasSSE2 = __builtin_cpu_supports("sse2");
+#else
+        bool hasAVX2 = false, hasSSE2 = false;
+#endif
+        // without AVX2 the scalar loop is faster, SSE2 still looks the colors up one at a time and then has to pack them
+        if (kernel == RowKernel::Best)
+            kernel = hasAVX2 ? RowKernel::AVX2 : RowKernel::Scalar;
+        if (kernel == RowKernel::AVX2 && !hasAVX2)
+            kernel = RowKernel::SSE2;
+        if (kernel == RowKernel::SSE2 && !hasSSE2)
+            kernel = RowKernel::Scalar;
+        return kernel;
+    }
+
+    static RowKernelFn s_rowKernel = compositeRowScalar;
+    static ScaledRowKernelFn s_scaledRowKernel = compositeRowScaledScalar;
+
+    RowKernel selectRowKernel(RowKernel kernel) {
+        kernel = supportedRowKernel(kernel);
+        switch (kernel) {
+#ifdef GIF_RENDER_X86
+            case RowKernel::AVX2: s_rowKernel = compositeRowAVX2; s_scaledRowKernel = compositeRowScaledAVX2; break;
+            // SSE2 has no variable permute, the scalar loop already looks every color up only once
+            case RowKernel::SSE2: s_rowKernel = compositeRowSSE2; s_scaledRowKernel = compositeRowScaledScalar; break;
+#endif
+            default: s_rowKernel = compositeRowScalar; s_scaledRowKernel = compositeRowScaledScalar; break;
+        }
+        return kernel;
+    }
+
+    // picked once at startup, so the hot path is a single indirect call
+    static RowKernel s_bestKernel = selectRowKernel(RowKernel::Best);
+
+    void compositeRow(uint32_t* dst, const uint8_t* src, size_t count, const uint32_t* lut, uint32_t transparentIndex) {
+        s_rowKernel(dst, src, count, lut, transparentIndex);
+    }
+
+    void compositeRowScaled(uint32_t* dst, const uint8_t* src, size_t count, size_t scale, const uint32_t* lut, uint32_t transparentIndex) {
+        s_scaledRowKernel(dst, src, count, scale, lut, transparentIndex);
+    }
+
+    void compositeFrame(uint32_t* canvas, size_t pitch, size_t canvasWidth, size_t canvasHeight, const GifFile::GifFrame& frame, const uint8_t* indices, const uint32_t* lut) {
+        // clip the frame rectangle to the canvas
+        if (frame.left >= canvasWidth || frame.top >= canvasHeight)
+            return;
+        size_t width  = (frame.left + frame.width  > canvasWidth)  ? canvasWidth  - frame.left : frame.width;
+        size_t height = (frame.top  + frame.height > canvasHeight) ? canvasHeight - frame.top  : frame.height;
+        uint32_t transparentIndex = frame.hasTransparency ? frame.transparencyIndex : NoTransparency;
+
+        const uint8_t* src = indices;
+        uint32_t* dst = canvas + frame.top * pitch + frame.left;
+        for (size_t y = 0; y < height; y++) {
+            compositeRow(dst, src, width, lut, transparentIndex);
+            src += frame.width;
+            dst += pitch;
+        }
+    }
+
+
+    // fills table with the source pixel sampled by each of count destination pixels, from the center of the destination pixel
+    static void sampleTable(std::vector<uint32_t>& table, size_t sourceSize, size_t count) {
+        table.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            table[i] = (uint32_t)((2 * i + 1) * sourceSize / (2 * count));
+        }
+    }
+
+    Canvas::Canvas(GifFile::GifFileReader& reader, uint32_t* pixels, size_t pitch, PixelLayout layout, size_t width, size_t height)
+        : m_reader(reader), m_palette(layout) {
+        resize(pixels, pitch, width, height);
+    }
+
+    void Canvas::resize(uint32_t* pixels, size_t pitch, size_t width, size_t height) {
+        size_t screenWidth = m_reader.gifHeader.scrWidth, screenHeight = m_reader.gifHeader.scrHeight;
+        m_pixels = pixels;
+        m_pitch = pitch;
+        m_width = width ? width : screenWidth;
+        m_height = height ? height : screenHeight;
+        m_lastFrame = NoFrame;
+        m_dirty = Rect{0, 0, 0, 0};
+        // the reader may hold another file by now, whose color tables can sit where the old ones were
+        m_background = m_palette.mapColor(m_reader.globalColorTable[m_reader.backgroundColorIndex]);
+        m_palette.forget();
+
+        // the tables are built once per size, compositing only looks them up
+        m_columnSource.clear();
+        m_rowSource.clear();
+        m_columnScale = 0;
+        if (m_width != screenWidth || m_height != screenHeight) {
+            sampleTable(m_columnSource, screenWidth, m_width);
+            sampleTable(m_rowSource, screenHeight, m_height);
+            m_rowIndices.resize(m_width);
+            // at a whole multiple of the screen width, canvas column x samples screen column x / scale
+            if (screenWidth > 0 && m_width > screenWidth && m_width % screenWidth == 0)
+                m_columnScale = m_width / screenWidth;
+        }
+
+        // the backup for "restore to previous" is sized up front, so drawing frames never allocates
+        size_t backupSize = 0;
+        for (auto& frame : m_reader.frames) {
+            if (frame.disposalMethod == 3) {
+                Rect r = frameRect(frame);
+                backupSize = std::max(backupSize, r.w * r.h);
+            }
+        }
+        m_backup.clear();
+        m_backup.reserve(backupSize);
+    }
+
+    void Canvas::clear() {
+        for (size_t y = 0; y < m_height; y++) {
+            std::fill(m_pixels + y * m_pitch, m_pixels + y * m_pitch + m_width, m_background);
+        }
+        m_lastFrame = NoFrame;
+        m_dirty = Rect{0, 0, m_width, m_height};
+    }
+
+    Rect Canvas::frameRect(const GifFile::GifFrame& frame) {
+        if (m_columnSource.empty()) {
+            size_t x = std::min<size_t>(frame.left, m_width);
+            size_t y = std::min<size_t>(frame.top, m_height);
+            return Rect{x, y, std::min<size_t>(frame.width, m_width - x), std::min<size_t>(frame.height, m_height - y)};
+        }
+
+        // the canvas columns and rows that sample a pixel of the frame. The tables never decrease, so they are ranges
+        size_t x0 = std::lower_bound(m_columnSource.begin(), m_columnSource.end(), (uint32_t)frame.left) - m_columnSource.begin();
+        size_t x1 = std::lower_bound(m_columnSource.begin(), m_columnSource.end(), (uint32_t)frame.left + frame.width) - m_columnSource.begin();
+        size_t y0 = std::lower_bound(m_rowSource.begin(), m_rowSource.end(), (uint32_t)frame.top) - m_rowSource.begin();
+        size_t y1 = std::lower_bound(m_rowSource.begin(), m_rowSource.end(), (uint32_t)frame.top + frame.height) - m_rowSource.begin();
+        return Rect{x0, y0, x1 - x0, y1 - y0};
+    }
+
+    void Canvas::compositeScaled(const GifFile::GifFrame& frame, const uint8_t* indices, const uint32_t* lut, Rect r) {
+        uint32_t transparentIndex = frame.hasTransparency ? frame.transparencyIndex : NoTransparency;
+        for (size_t y = r.y; y < r.y + r.h; y++) {
+            uint32_t* dst = m_pixels + y * m_pitch + r.x;
+            /* canvas rows that sample the same screen row are only ever written together, so they always hold the same
+               pixels: a magnified row is composited once and copied to the rows below it */
+            if (y > r.y && m_rowSource[y] == m_rowSource[y - 1]) {
+                std::copy(dst - m_pitch, dst - m_pitch + r.w, dst);
+                continue;
+            }
+
+            const uint8_t* src = indices + (size_t)(m_rowSource[y] - frame.top) * frame.width;
+            if (m_columnScale) {
+                // r starts and ends on whole screen pixels, so the row is the frame row with every index repeated
+                compositeRowScaled(dst, src + (m_columnSource[r.x] - frame.left), r.w / m_columnScale, m_columnScale, lut, transparentIndex);
+                continue;
+            }
+            // gather the sampled indices of the row, then composite them like an unscaled row
+            for (size_t x = 0; x < r.w; x++) {
+                m_rowIndices[x] = src[m_columnSource[r.x + x] - frame.left];
+            }
+            compositeRow(dst, m_rowIndices.data(), r.w, lut, transparentIndex);
+        }
+    }
+
+    void Canvas::dispose() {
+        if (m_lastFrame == NoFrame)
+            return;
+        const GifFile::GifFrame& last = m_reader.frames[m_lastFrame];
+        Rect r = frameRect(last);
+
+        if (last.disposalMethod == 2) {
+            // restore to background color
+            for (size_t row = r.y; row < r.y + r.h; row++) {
+                std::fill(m_pixels + row * m_pitch + r.x, m_pixels + row * m_pitch + r.x + r.w, m_background);
+            }
+            m_dirty = m_dirty.unite(r);
+        } else if (last.disposalMethod == 3 && m_backup.size() == r.w * r.h) {
+            // restore to previous
+            for (size_t row = 0; row < r.h; row++) {
+                std::copy(m_backup.begin() + row * r.w, m_backup.begin() + (row + 1) * r.w, m_pixels + (r.y + row) * m_pitch + r.x);
+            }
+            m_dirty = m_dirty.unite(r);
+        }
+        m_lastFrame = NoFrame;
+    }
+
+    void Canvas::drawFrame(size_t i, const uint8_t* indices) {
+        auto start = std::chrono::steady_clock::now();
+        // every loop starts from the background
+        if (i == 0)
+            clear();
+        else
+            dispose();
+
+        const GifFile::GifFrame& frame = m_reader.frames[i];
+        Rect r = frameRect(frame);
+        if (frame.disposalMethod == 3) {
+            // keep what the frame covers, it is put back before the next frame
+            m_backup.resize(r.w * r.h);
+            for (size_t row = 0; row < r.h; row++) {
+                std::copy(m_pixels + (r.y + row) * m_pitch + r.x, m_pixels + (r.y + row) * m_pitch + r.x + r.w, m_backup.begin() + row * r.w);
+            }
+        }
+        m_dirty = m_dirty.unite(r);
+
+        // interlaced frames were put in row order when they were decoded
+        const uint32_t* lut = m_palette.get(m_reader, frame);
+        if (m_columnSource.empty())
+            compositeFrame(m_pixels, m_pitch, m_width, m_height, frame, indices, lut);
+        else
+            compositeScaled(frame, indices, lut, r);
+        m_lastFrame = i;
+
+        frame.counters.compositeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        frame.counters.composites++;
+    }
+
+    void Canvas::save(CanvasSnapshot& snapshot) {
+        snapshot.frameIndex = m_lastFrame;
+        snapshot.pixels.resize(m_width * m_height);
+        for (size_t y = 0; y < m_height; y++) {
+            std::copy(m_pixels + y * m_pitch, m_pixels + y * m_pitch + m_width, snapshot.pixels.begin() + y * m_width);
+        }
+        snapshot.backup = m_backup;
+    }
+
+    void Canvas::restore(const CanvasSnapshot& snapshot) {
+        for (size_t y = 0; y < m_height; y++) {
+            std::copy(snapshot.pixels.begin() + y * m_width, snapshot.pixels.begin() + (y + 1) * m_width, m_pixels + y * m_pitch);
+        }
+        m_backup = snapshot.backup;
+        m_lastFrame = snapshot.frameIndex;
+        m_dirty = Rect{0, 0, m_width, m_height};
+    }
+
+} // namespace GifRender
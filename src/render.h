@@ -0,0 +1,144 @@
+#pragma once
+
+#include "gif.h"
+#include <algorithm>
+
+
+namespace GifRender {
+    // Position of the color channels inside a 32 bit canvas pixel
+    struct PixelLayout {
+        uint8_t rShift, gShift, bShift;
+        uint32_t alphaMask; // ORed into every pixel, 0 if the format has no alpha
+    };
+
+    // 256 entry lookup table from a color index to a canvas pixel, rebuilt only when the color table changes
+    class PaletteLut {
+    public:
+        PaletteLut(PixelLayout layout) : m_layout(layout) {}
+
+        // returns the table for the color table frame uses (its Local Color Table or the reader's Global Color Table)
+        const uint32_t* get(GifFile::GifFileReader& reader, const GifFile::GifFrame& frame);
+        // returns the table for colorTable, indices at or past entryCount map to black
+        const uint32_t* get(const GifFile::GifGctColorEntry* colorTable, size_t entryCount);
+        // makes the next get() build the table again, for color tables that changed in place
+        void forget() { m_source = nullptr; }
+
+        uint32_t mapColor(GifFile::GifGctColorEntry color) {
+            return ((uint32_t)color.r << m_layout.rShift) | ((uint32_t)color.g << m_layout.gShift) | ((uint32_t)color.b << m_layout.bShift) | m_layout.alphaMask;
+        }
+
+    private:
+        PixelLayout m_layout;
+        const GifFile::GifGctColorEntry* m_source = nullptr;
+        uint32_t m_colors[256];
+    };
+
+    // Implementations of the row kernel. Best picks AVX2 if the CPU supports it, else Scalar (SSE2 is slower than Scalar)
+    enum class RowKernel { Best, Scalar, SSE2, AVX2 };
+
+    // selects the kernel used by compositeRow(). Returns the kernel actually selected (falls back if the CPU lacks support)
+    RowKernel selectRowKernel(RowKernel kernel);
+
+    /*
+     * Writes lut[src[i]] to dst[i] for count pixels. Pixels whose index equals transparentIndex keep the value in dst.
+     * A transparentIndex of NoTransparency (outside the byte range) never matches.
+     */
+    static const uint32_t NoTransparency = 256;
+    void compositeRow(uint32_t* dst, const uint8_t* src, size_t count, const uint32_t* lut, uint32_t transparentIndex);
+    /*
+     * Like compositeRow(), but every index of src covers scale pixels of dst, count * scale pixels in total.
+     * Magnifies a row by a whole factor while compositing it, every color is looked up once.
+     */
+    void compositeRowScaled(uint32_t* dst, const uint8_t* src, size_t count, size_t scale, const uint32_t* lut, uint32_t transparentIndex);
+
+    /*
+     * Draws frame, whose decoded indices are passed separately, onto a canvas of canvasWidth x canvasHeight pixels
+     * with pitch pixels per canvas row. The frame rectangle is clipped to the canvas.
+     */
+    void compositeFrame(uint32_t* canvas, size_t pitch, size_t canvasWidth, size_t canvasHeight, const GifFile::GifFrame& frame, const uint8_t* indices, const uint32_t* lut);
+    // Rectangle on the canvas, empty if w or h is 0
+    struct Rect {
+        size_t x, y, w, h;
+
+        bool empty() const { return w == 0 || h == 0; }
+        // smallest rectangle containing both
+        Rect unite(const Rect& other) const {
+            if (empty())
+                return other;
+            if (other.empty())
+                return *this;
+            size_t left = std::min(x, other.x), top = std::min(y, other.y);
+            size_t right = std::max(x + w, other.x + other.w), bottom = std::max(y + h, other.y + other.h);
+            return Rect{left, top, right - left, bottom - top};
+        }
+    };
+
+    // Everything needed to continue compositing from a given frame: the canvas pixels and the pending disposal
+    struct CanvasSnapshot {
+        size_t frameIndex;
+        std::vector<uint32_t> pixels; // width*height, without any pitch padding
+        std::vector<uint32_t> backup; // area under the frame, if it gets restored (disposal method 3)
+    };
+
+    /*
+     * Composites the frames of a reader onto a 32 bit pixel buffer, in playback order.
+     * The disposal method of a frame is applied when the next frame is drawn, and frame 0 always starts from
+     * the background color.
+     */
+    class Canvas {
+    public:
+        /* pixels holds width x height pixels. Without a size it is the logical screen size, any other size is filled by
+           nearest neighbor sampling of the screen, which is done while compositing so a full size canvas never exists */
+        Canvas(GifFile::GifFileReader& reader, uint32_t* pixels, size_t pitch, PixelLayout layout, size_t width = 0, size_t height = 0);
+        /* moves the canvas to new pixels of a new size (0 for the logical screen size), for example when the window is resized.
+           The pixels are left as they are and the previous frame is forgotten, so the next frame drawn should be frame 0.
+           Also takes up the file the reader holds now, after GifFileReader::reset(), without allocating once the tables fit */
+        void resize(uint32_t* pixels, size_t pitch, size_t width = 0, size_t height = 0);
+
+        // fills the whole canvas with the background color and forgets the previous frame
+        void clear();
+        // draws frame i (with its decoded indices) on top of what the previous frame left behind
+        void drawFrame(size_t i, const uint8_t* indices);
+        // applies the disposal method of the last drawn frame now instead of when the next frame is drawn
+        void dispose();
+
+        void save(CanvasSnapshot& snapshot);
+        void restore(const CanvasSnapshot& snapshot);
+
+        /* returns the area changed since the last call and resets it. After a normal frame this is the frame rectangle
+           plus whatever the disposal of the previous frame touched, which is usually far less than the whole canvas */
+        Rect takeDirtyRect() {
+            Rect dirty = m_dirty;
+            m_dirty = Rect{0, 0, 0, 0};
+            return dirty;
+        }
+
+        size_t width() { return m_width; }
+        size_t height() { return m_height; }
+        uint32_t* pixels() { return m_pixels; }
+
+        static const size_t NoFrame = (size_t)-1;
+
+    private:
+        // clips the rectangle of frame to the canvas, in canvas pixels
+        Rect frameRect(const GifFile::GifFrame& frame);
+        // composites frame onto r (its frameRect()) through the source tables
+        void compositeScaled(const GifFile::GifFrame& frame, const uint8_t* indices, const uint32_t* lut, Rect r);
+
+        GifFile::GifFileReader& m_reader;
+        uint32_t* m_pixels;
+        size_t m_pitch;
+        size_t m_width, m_height;
+        PaletteLut m_palette;
+        uint32_t m_background;
+
+        // screen column and row sampled by every canvas column and row, empty if the canvas is the screen size
+        std::vector<uint32_t> m_columnSource, m_rowSource;
+        std::vector<uint8_t> m_rowIndices; // indices of one canvas row, gathered through m_columnSource
+        size_t m_columnScale = 0; // canvas columns per screen column if that is a whole number above 1, else 0
+
+        size_t m_lastFrame = NoFrame; // frame whose disposal is still pending
+        std::vector<uint32_t> m_backup;
+        Rect m_dirty = Rect{0, 0, 0, 0};
+    };
+} // namespace GifRender
@@ -0,0 +1,128 @@
+#include "wall.h"
+#include <cmath>
+#include <exception>
+
+namespace GifPlayer {
+
+    bool Wall::open(const std::vector<const char*>& paths, size_t maxWidth, size_t maxHeight) {
+        m_tiles.clear();
+        size_t cellWidth = 1, cellHeight = 1, largestFrame = 0;
+        for (const char* path : paths) {
+            WallTile tile;
+            tile.reader.reset(new GifFile::GifFileReader(path));
+            // only the structure is read, frames are decoded when they are due
+            if (tile.reader->scanFile()) {
+                printf("Could not read %s, leaving it out.\n", path);
+                continue;
+            }
+            cellWidth = std::max<size_t>(cellWidth, tile.reader->gifHeader.scrWidth);
+            cellHeight = std::max<size_t>(cellHeight, tile.reader->gifHeader.scrHeight);
+            for (auto& frame : tile.reader->frames) {
+                largestFrame = std::max(largestFrame, (size_t)frame.width * frame.height);
+            }
+            tile.schedule = FrameScheduler(m_ticksPerSecond);
+            m_tiles.push_back(std::move(tile));
+        }
+        if (m_tiles.empty())
+            return 1;
+        m_scratch.resize(largestFrame);
+
+        // as square a grid as possible, with cells as large as the largest animation unless that does not fit
+        size_t columns = (size_t)std::ceil(std::sqrt((double)m_tiles.size()));
+        size_t rows = (m_tiles.size() + columns - 1) / columns;
+        double shrink = std::min(1.0, std::min((double)maxWidth / (columns * cellWidth), (double)maxHeight / (rows * cellHeight)));
+        cellWidth = std::max<size_t>(1, (size_t)(cellWidth * shrink));
+        cellHeight = std::max<size_t>(1, (size_t)(cellHeight * shrink));
+        m_width = columns * cellWidth;
+        m_height = rows * cellHeight;
+
+        for (size_t i = 0; i < m_tiles.size(); i++) {
+            GifFile::GifHeader& header = m_tiles[i].reader->gifHeader;
+            size_t width = std::max<size_t>(1, header.scrWidth), height = std::max<size_t>(1, header.scrHeight);
+            double scale = std::min((double)cellWidth / width, (double)cellHeight / height);
+            size_t tileWidth = std::max<size_t>(1, std::min(cellWidth, (size_t)(width * scale + 0.5)));
+            size_t tileHeight = std::max<size_t>(1, std::min(cellHeight, (size_t)(height * scale + 0.5)));
+            // centered in its cell
+            m_tiles[i].area = GifRender::Rect{(i % columns) * cellWidth + (cellWidth - tileWidth) / 2,
+                                              (i / columns) * cellHeight + (cellHeight - tileHeight) / 2, tileWidth, tileHeight};
+        }
+        return 0;
+    }
+
+    void Wall::start(uint32_t* pixels, size_t pitch, GifRender::PixelLayout layout, uint64_t now) {
+        m_queue = decltype(m_queue)();
+        for (size_t i = 0; i < m_tiles.size(); i++) {
+            WallTile& tile = m_tiles[i];
+            GifRender::Rect& area = tile.area;
+            // the tile's canvas is its area of the window, scaled while compositing if the animation is not at its own size
+            tile.canvas.reset(new GifRender::Canvas(*tile.reader, pixels + area.y * pitch + area.x, pitch, layout, area.w, area.h));
+            tile.next = 0;
+            tile.failed = false;
+            if (tile.reader->frames.empty())
+                continue;
+            tile.schedule.reset(now);
+            m_queue.push(Deadline(tile.schedule.deadline(), i));
+        }
+    }
+
+    bool Wall::advance(WallTile& tile, uint64_t now) {
+        const GifFile::GifFrame& frame = tile.reader->frames[tile.next];
+        try {
+            tile.reader->decodeIndices(frame, m_scratch.data());
+        } catch (const std::exception& e) {
+            printf("%s: frame %li failed to decode: %s\n", tile.reader->filename.c_str(), (long)tile.next, e.what());
+            tile.failed = true;
+            return 1;
+        }
+        tile.canvas->drawFrame(tile.next, m_scratch.data());
+        tile.composited++;
+        // presenting is up to the caller, so a late frame is never skipped here; the scheduler only keeps the deadlines
+        tile.schedule.frameComposited(now, frame.delayTime);
+        tile.next = (tile.next + 1) % tile.reader->frames.size();
+        return 0;
+    }
+
+    size_t Wall::update(uint64_t now) {
+        size_t composited = 0;
+        // every tile is in the queue once, so this only visits the tiles with a frame due
+        m_due.clear();
+        while (!m_queue.empty() && m_queue.top().first <= now) {
+            m_due.push_back(m_queue.top().second);
+            m_queue.pop();
+        }
+        for (size_t i : m_due) {
+            WallTile& tile = m_tiles[i];
+            // a tile that is behind (or has frames without delay) catches up, but by at most one loop per update
+            for (size_t step = 0; step < tile.reader->frames.size() && tile.schedule.deadline() <= now; step++) {
+                if (advance(tile, now))
+                    break;
+                composited++;
+            }
+            // a single frame starts from the background every time, so drawing it again would change nothing
+            if (!tile.failed && tile.reader->frames.size() > 1)
+                m_queue.push(Deadline(tile.schedule.deadline(), i));
+        }
+        return composited;
+    }
+
+    void Wall::takeDirtyRects(std::vector<GifRender::Rect>& rects) {
+        // only the tiles that were due can have changed
+        for (size_t i : m_due) {
+            WallTile& tile = m_tiles[i];
+            GifRender::Rect dirty = tile.canvas->takeDirtyRect();
+            if (!dirty.empty())
+                rects.push_back(GifRender::Rect{tile.area.x + dirty.x, tile.area.y + dirty.y, dirty.w, dirty.h});
+        }
+    }
+
+    void Wall::printStats(FILE* out) {
+        uint64_t total = 0;
+        for (auto& tile : m_tiles) {
+            fprintf(out, "%8llu frames composited, %llu late: %s\n", (unsigned long long)tile.composited,
+                    (unsigned long long)tile.schedule.stats().dropped, tile.reader->filename.c_str());
+            total += tile.composited;
+        }
+        fprintf(out, "%8llu frames composited by %li tiles\n", (unsigned long long)total, (long)m_tiles.size());
+    }
+
+} // namespace GifPlayer
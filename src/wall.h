@@ -0,0 +1,74 @@
+#pragma once
+
+#include "gif.h"
+#include "render.h"
+#include "player.h"
+#include <memory>
+#include <queue>
+
+
+namespace GifPlayer {
+    // One animation of a Wall and the part of the window it is drawn to
+    struct WallTile {
+        std::unique_ptr<GifFile::GifFileReader> reader;
+        std::unique_ptr<GifRender::Canvas> canvas;
+        GifRender::Rect area = GifRender::Rect{0, 0, 0, 0}; // canvas position and size in the window
+        FrameScheduler schedule{1};
+        size_t next = 0; // next frame to composite
+        uint64_t composited = 0; // frames composited so far
+        bool failed = false; // a frame could not be decoded, the tile stays on its last frame
+    };
+
+    /*
+     * Plays many GIF files at once, each in its own tile of one window, on the calling thread.
+     * The tile whose next frame is due first is kept at the top of a min-heap, so every update only touches the tiles
+     * that change and an idle wall costs nothing. A still image (a file of one frame) is composited once and leaves the heap.
+     * Frames are decoded when they are due, into one buffer shared by every tile.
+     * The clock is passed in, so the wall does not depend on SDL.
+     */
+    class Wall {
+    public:
+        // ticksPerSecond: resolution of the clock that every now is read from
+        Wall(uint64_t ticksPerSecond) : m_ticksPerSecond(ticksPerSecond) {}
+
+        /*
+         * reads the structure of every file and lays them out in a grid that fits maxWidth x maxHeight. Every animation is
+         * scaled to fit its cell, keeping its aspect ratio. Files that cannot be read are reported and left out
+         * Returns: 0 on success, 1 if none of the files could be read
+         */
+        bool open(const std::vector<const char*>& paths, size_t maxWidth, size_t maxHeight);
+
+        // size of the whole wall
+        size_t width() { return m_width; }
+        size_t height() { return m_height; }
+        size_t tileCount() { return m_tiles.size(); }
+
+        /* makes the tiles composite straight into pixels (width() x height() pixels, pitch pixels per row)
+           and schedules the first frame of every tile at now */
+        void start(uint32_t* pixels, size_t pitch, GifRender::PixelLayout layout, uint64_t now);
+
+        // composites every frame that is due at now. Returns the number of frames composited
+        size_t update(uint64_t now);
+        // when the next frame of any tile is due, UINT64_MAX if no tile is playing
+        uint64_t nextDeadline() { return m_queue.empty() ? UINT64_MAX : m_queue.top().first; }
+
+        // appends the areas of the window changed by the last update()
+        void takeDirtyRects(std::vector<GifRender::Rect>& rects);
+
+        // prints the frames composited per tile and in total
+        void printStats(FILE* out);
+
+    private:
+        // composites the next frame of tile at now and moves its deadline on. Returns: 0 on success, 1 on failure
+        bool advance(WallTile& tile, uint64_t now);
+
+        uint64_t m_ticksPerSecond;
+        size_t m_width = 0, m_height = 0;
+        std::vector<WallTile> m_tiles;
+        // (deadline, tile) of every playing tile, the earliest deadline on top
+        typedef std::pair<uint64_t, size_t> Deadline;
+        std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> m_queue;
+        std::vector<size_t> m_due; // tiles taken off the queue by update()
+        std::vector<GifFile::byte> m_scratch; // decoded indices of one frame, sized for the largest frame of all files
+    };
+} // namespace GifPlayer
@@ -0,0 +1,254 @@
+/*
+ * Regression tests, built and run by "python build.py test" from the repository root (they read samples/).
+ * Every test prints its name and whether it passed, the exit code is the number of failed tests.
+ */
+#include "../src/gif.h"
+#include "../src/gifdecode.h"
+#include "../src/optimize.h"
+#include "../src/player.h"
+#include "../src/wall.h"
+#include <filesystem>
+#include <exception>
+
+static int s_checksFailed = 0;
+
+// records a failed check with its location, the test goes on
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            printf("  %s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            s_checksFailed++; \
+        } \
+    } while (0)
+
+// every frame of a scanned file can still be fetched with getFrame(), decoded as decodeIndices() decodes it
+static void testScanThenGetFrame() {
+    GifFile::GifFileReader reader("samples/car.gif");
+    CHECK(reader.scanFile() == 0);
+    CHECK(!reader.frames.empty());
+    std::vector<GifFile::byte> expected;
+    for (size_t i = 0; i < reader.frames.size(); i++) {
+        CHECK(!reader.frames[i].isDecoded);
+        GifFile::GifFrame& frame = reader.getFrame(i);
+        CHECK(frame.isDecoded && frame.indices != nullptr);
+        expected.resize((size_t)frame.width * frame.height);
+        reader.decodeIndices(frame, expected.data());
+        CHECK(memcmp(frame.indices, expected.data(), expected.size()) == 0);
+    }
+}
+
+// frames without a delay are shown for the default delay, each of them presented on time and none dropped
+static void testSchedulerZeroDelay() {
+    // a clock in milliseconds, read exactly when every frame is due
+    GifPlayer::FrameScheduler scheduler(1000);
+    scheduler.reset(0);
+    const size_t frameCount = 50;
+    for (size_t i = 0; i < frameCount; i++) {
+        uint64_t now = scheduler.deadline();
+        CHECK(now == i * GifPlayer::FrameScheduler::DefaultDelayMs);
+        if (scheduler.frameComposited(now, 0))
+            scheduler.framePresented(now);
+    }
+    CHECK(scheduler.stats().presented == frameCount);
+    CHECK(scheduler.stats().dropped == 0);
+    CHECK(scheduler.stats().resyncs == 0);
+
+    // delays of one hundredth of a second are clamped too, longer ones are kept
+    CHECK(GifPlayer::FrameScheduler::frameDelay(10) == GifPlayer::FrameScheduler::DefaultDelayMs);
+    CHECK(GifPlayer::FrameScheduler::frameDelay(20) == 20);
+}
+
+using GifFile::byte;
+using GifFile::GifGctColorEntry;
+
+// 256 colors that are all different, and none of them black, red, green or white
+static GifGctColorEntry manyColors(size_t i) {
+    return GifGctColorEntry{(byte)i, (byte)(255 - i), 128};
+}
+
+// writes a frame of width x height at left, top. lct is its Local Color Table of 256 entries, or nullptr for the Global Color Table
+static void writeFrame(GifFile::GifFileWriter& writer, GifFile::word left, GifFile::word top, GifFile::word width, GifFile::word height,
+                       byte disposalMethod, const GifGctColorEntry* lct, int transparencyIndex, const std::vector<byte>& indices) {
+    GifFile::GifFrame frame{};
+    frame.delayTime = 100;
+    frame.left = left;
+    frame.top = top;
+    frame.width = width;
+    frame.height = height;
+    frame.disposalMethod = disposalMethod;
+    frame.hasTransparency = transparencyIndex >= 0;
+    frame.transparencyIndex = transparencyIndex >= 0 ? (GifFile::word)transparencyIndex : 0;
+    frame.localColorTable = lct;
+    frame.lctEntryCount = lct ? 256 : 0;
+    writer.writeFrame(frame, indices.data());
+}
+
+// optimizes input, then checks that every frame composites as the output frame that shows it and that outputFrames has outputCount frames
+static void checkOptimized(const std::vector<byte>& input, size_t outputCount) {
+    GifFile::GifFileReader reader("");
+    CHECK(reader.scanMemory(input.data(), input.size()) == 0);
+    GifFile::GifFileWriter writer;
+    std::vector<size_t> outputFrames;
+    CHECK(GifOptimize::optimize(reader, writer, &outputFrames) == 0);
+    CHECK(outputFrames.size() == reader.frames.size());
+    CHECK(!outputFrames.empty() && outputFrames.back() + 1 == outputCount);
+
+    GifDecode::Decoder expected, actual;
+    CHECK(expected.open(input.data(), input.size()) == 0);
+    CHECK(actual.open(writer.data().data(), writer.data().size()) == 0);
+    CHECK(actual.frameCount() == outputCount);
+    std::vector<uint8_t> expectedPixels(expected.width() * expected.height() * 4), actualPixels(expectedPixels.size());
+    for (size_t i = 0; i < outputFrames.size() && outputFrames[i] < actual.frameCount(); i++) {
+        CHECK(expected.decodeFrame(i, expectedPixels.data(), expected.width() * 4) == 0);
+        CHECK(actual.decodeFrame(outputFrames[i], actualPixels.data(), actual.width() * 4) == 0);
+        CHECK(expectedPixels == actualPixels);
+    }
+}
+
+// frames that change more colors at once than a color table holds are written as they are, instead of failing
+static void testOptimizeTooManyColors() {
+    const GifGctColorEntry gct[4] = {{0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {255, 255, 255}};
+    GifGctColorEntry lct[256];
+    std::vector<byte> every(256);
+    for (size_t i = 0; i < 256; i++) {
+        lct[i] = manyColors(i);
+        every[i] = (byte)i;
+    }
+
+    // 256 colors and the background around them: the first frame is written as it is, the rest is optimized as usual
+    GifFile::GifFileWriter writer;
+    writer.writeHeader(20, 20, gct, 4, 0);
+    writer.writeLoopExtension(0);
+    writeFrame(writer, 0, 0, 16, 16, 1, lct, -1, every);
+    writeFrame(writer, 4, 4, 8, 8, 1, nullptr, -1, std::vector<byte>(64, 1));
+    writeFrame(writer, 4, 4, 8, 8, 1, nullptr, -1, std::vector<byte>(64, 1));
+    writer.writeTrailer();
+    checkOptimized(writer.data(), 2);
+
+    /* 255 colors and a transparent corner over a frame restored to the background, next to a green column: the frame
+       cannot be written as it is over the optimized frames before it, so every frame is */
+    std::vector<byte> indices(17 * 16);
+    for (size_t y = 0; y < 16; y++) {
+        for (size_t x = 0; x < 17; x++) {
+            size_t color = y * 16 + x;
+            indices[y * 17 + x] = (byte)(x < 16 ? std::min<size_t>(color, 255) : y == 0 ? 0 : 255);
+        }
+    }
+    writer.reset();
+    writer.writeHeader(20, 20, gct, 4, 0);
+    writer.writeLoopExtension(0);
+    writeFrame(writer, 0, 0, 20, 20, 1, nullptr, -1, std::vector<byte>(400, 2));
+    writeFrame(writer, 0, 0, 16, 16, 2, nullptr, -1, std::vector<byte>(256, 3));
+    writeFrame(writer, 0, 0, 17, 16, 1, lct, 255, indices);
+    writeFrame(writer, 2, 2, 4, 4, 1, nullptr, -1, std::vector<byte>(16, 1));
+    writer.writeTrailer();
+    checkOptimized(writer.data(), 4);
+}
+
+// every frame of a file with an empty logical screen maps to an output frame that exists
+static void testOptimizeEmptyScreen() {
+    const GifGctColorEntry gct[4] = {{0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {255, 255, 255}};
+    GifFile::GifFileWriter writer;
+    writer.writeHeader(0, 0, gct, 4, 0);
+    writer.writeLoopExtension(0);
+    writeFrame(writer, 0, 0, 4, 4, 1, nullptr, -1, std::vector<byte>(16, 1));
+    writeFrame(writer, 0, 0, 4, 4, 1, nullptr, -1, std::vector<byte>(16, 2));
+    writer.writeTrailer();
+    checkOptimized(writer.data(), 2);
+}
+
+// a seek that fails to decode a frame leaves the current frame and the canvas as they were
+static void testFailedSeek() {
+    const GifGctColorEntry gct[4] = {{0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {255, 255, 255}};
+    GifFile::GifFileWriter writer;
+    writer.writeHeader(8, 8, gct, 4, 0);
+    writer.writeLoopExtension(0);
+    size_t corruptFrame = 0;
+    for (byte color : {1, 2, 3, 1}) {
+        corruptFrame = writer.data().size();
+        writeFrame(writer, 0, 0, 8, 8, 1, nullptr, -1, std::vector<byte>(64, color));
+    }
+    writer.writeTrailer();
+    // the LZW minimum code size of the last frame, after its Graphic Control Extension and Image Descriptor, is out of range
+    std::vector<byte> data = writer.data();
+    data[corruptFrame + 8 + 10] = 12;
+
+    GifFile::GifFileReader reader("");
+    CHECK(reader.scanMemory(data.data(), data.size()) == 0);
+    std::vector<uint32_t> pixels(64);
+    GifRender::Canvas canvas(reader, pixels.data(), 8, GifRender::PixelLayout{0, 8, 16, 0xFF000000});
+    GifPlayer::Player player(reader, canvas, 2);
+    player.seek(1);
+    CHECK(player.currentFrame() == 1);
+    std::vector<uint32_t> shown = pixels;
+    // frame 2 is composited before frame 3 fails
+    player.seek(3);
+    CHECK(player.currentFrame() == 1);
+    CHECK(pixels == shown);
+    player.stop();
+}
+
+// a wall of still images composites every tile once and then has nothing left to do
+static void testWallOfStills() {
+    const GifGctColorEntry gct[4] = {{0, 0, 0}, {255, 0, 0}, {0, 255, 0}, {255, 255, 255}};
+    std::vector<std::string> paths;
+    for (byte color = 1; color <= 3; color++) {
+        GifFile::GifFileWriter writer;
+        writer.writeHeader(8, 8, gct, 4, 0);
+        writeFrame(writer, 0, 0, 8, 8, 1, nullptr, -1, std::vector<byte>(64, color));
+        writer.writeTrailer();
+        paths.push_back((std::filesystem::temp_directory_path() / ("gifplayer-still-" + std::to_string(color) + ".gif")).string());
+        CHECK(writer.saveFile(paths.back().c_str()) == 0);
+    }
+    std::vector<const char*> files;
+    for (auto& path : paths) {
+        files.push_back(path.c_str());
+    }
+
+    // a clock in milliseconds, updated for a minute of playback
+    GifPlayer::Wall wall(1000);
+    CHECK(wall.open(files, 64, 64) == 0);
+    std::vector<uint32_t> pixels(wall.width() * wall.height());
+    wall.start(pixels.data(), wall.width(), GifRender::PixelLayout{0, 8, 16, 0xFF000000}, 0);
+    size_t composited = 0;
+    for (uint64_t now = 0; now < 60000; now += 10) {
+        composited += wall.update(now);
+    }
+    CHECK(composited == paths.size());
+    CHECK(wall.nextDeadline() == UINT64_MAX);
+
+    std::error_code error;
+    for (auto& path : paths) {
+        std::filesystem::remove(path, error);
+    }
+}
+
+int main() {
+    struct Test {
+        const char* name;
+        void (*run)();
+    };
+    static const Test tests[] = {
+        {"scan then getFrame", testScanThenGetFrame},
+        {"scheduler with zero delays", testSchedulerZeroDelay},
+        {"optimize with too many colors", testOptimizeTooManyColors},
+        {"optimize with an empty screen", testOptimizeEmptyScreen},
+        {"failed seek", testFailedSeek},
+        {"wall of still images", testWallOfStills},
+    };
+
+    int failed = 0;
+    for (const Test& test : tests) {
+        int before = s_checksFailed;
+        try {
+            test.run();
+        } catch (const std::exception& e) {
+            printf("  exception: %s\n", e.what());
+            s_checksFailed++;
+        }
+        bool passed = s_checksFailed == before;
+        printf("%s: %s\n", test.name, passed ? "PASS" : "FAIL");
+        failed += passed ? 0 : 1;
+    }
+    return failed;
+}
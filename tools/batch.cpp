@@ -0,0 +1,285 @@
+/*
+ * Headless batch transcoder. Decodes and composites every frame of every GIF file it is given and writes
+ * the frames as raw RGBA or PPM images, or only prints a checksum per file. The info format only scans the
+ * structure of every file and prints its size, frame count and duration without decoding anything.
+ * Files are spread over a work-stealing thread pool, a file that fails does not affect the others.
+ * Built by "python build.py batch".
+ */
+#include "../src/gifdecode.h"
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <deque>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+
+
+enum class OutputFormat { Checksum, Rgba, Ppm, Info };
+
+struct FileJob {
+    std::string path;
+    bool failed = false;
+    size_t frames = 0;
+    uint64_t checksum = 0;
+    size_t width = 0, height = 0; // logical screen size
+    uint64_t duration = 0; // milliseconds
+};
+
+/*
+ * Every worker owns a queue of files. It takes files from the back of its own queue and, once that is empty,
+ * steals from the front of another worker's queue, so a worker that got a few large files does not hold up the rest.
+ */
+class WorkStealingPool {
+public:
+    WorkStealingPool(size_t workerCount) : m_queues(workerCount) {}
+
+    void push(size_t worker, size_t job) { m_queues[worker].jobs.push_back(job); }
+
+    // takes the next job for worker. Returns false once every queue is empty
+    bool take(size_t worker, size_t& job) {
+        {
+            Queue& own = m_queues[worker];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = own.jobs.back();
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < m_queues.size(); i++) {
+            Queue& victim = m_queues[(worker + i) % m_queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = victim.jobs.front();
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+    std::vector<Queue> m_queues;
+};
+
+// FNV-1a over bytes, continuing from hash
+static uint64_t fnv1a(uint64_t hash, const uint8_t* bytes, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// writes one frame in format to outDir. Returns: 0 on success, 1 on failure
+static bool writeFrame(const std::string& outDir, const std::string& name, size_t frame, OutputFormat format,
+                       const uint8_t* rgba, size_t width, size_t height, std::vector<uint8_t>& rgb) {
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "_%04lu.%s", (unsigned long)frame, format == OutputFormat::Ppm ? "ppm" : "rgba");
+    std::string path = (std::filesystem::path(outDir) / (name + suffix)).string();
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL)
+        return 1;
+
+    bool failed;
+    if (format == OutputFormat::Ppm) {
+        // PPM has no alpha channel
+        fprintf(out, "P6\n%lu %lu\n255\n", (unsigned long)width, (unsigned long)height);
+        rgb.resize(width * height * 3);
+        for (size_t i = 0; i < width * height; i++) {
+            rgb[i * 3 + 0] = rgba[i * 4 + 0];
+            rgb[i * 3 + 1] = rgba[i * 4 + 1];
+            rgb[i * 3 + 2] = rgba[i * 4 + 2];
+        }
+        failed = fwrite(rgb.data(), 1, rgb.size(), out) != rgb.size();
+    } else {
+        failed = fwrite(rgba, 1, width * height * 4, out) != width * height * 4;
+    }
+    return fclose(out) != 0 || failed;
+}
+
+// what a worker keeps from file to file, so it stops allocating once it has seen its largest file
+struct WorkerState {
+    GifDecode::Decoder decoder;
+    GifFile::GifFileReader scanner{""};
+    std::vector<uint8_t> rgba, rgb;
+};
+
+// true if path has the extension .gif, in any case
+static bool isGifPath(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return extension == ".gif";
+}
+
+/* appends the GIF files in directory and all of its subdirectories to found. A directory that cannot be read is reported
+   and skipped with everything below it, the rest is still searched. Symbolic links to directories are not followed */
+static void findGifFiles(const std::filesystem::path& directory, std::vector<std::string>& found) {
+    std::error_code error;
+    std::filesystem::directory_iterator entry(directory, error), end;
+    for (; !error && entry != end; entry.increment(error)) {
+        std::error_code typeError;
+        if (entry->is_directory(typeError) && !entry->is_symlink(typeError))
+            findGifFiles(entry->path(), found);
+        else if (entry->is_regular_file(typeError) && isGifPath(entry->path()))
+            found.push_back(entry->path().string());
+    }
+    if (error)
+        printf("Could not read %s: %s\n", directory.string().c_str(), error.message().c_str());
+}
+
+// reads only the structure of job. Returns: 0 on success, 1 on failure
+static bool scanFile(FileJob& job, WorkerState& state) {
+    state.scanner.reset(job.path.c_str());
+    if (state.scanner.scanFile()) {
+        fprintf(stderr, "%s: not a readable GIF file\n", job.path.c_str());
+        return 1;
+    }
+    job.frames = state.scanner.frames.size();
+    job.width = state.scanner.gifHeader.scrWidth;
+    job.height = state.scanner.gifHeader.scrHeight;
+    job.duration = state.scanner.totalDuration();
+    return 0;
+}
+
+// decodes every frame of job. Returns: 0 on success, 1 on failure
+static bool transcodeFile(FileJob& job, size_t index, OutputFormat format, const std::string& outDir, WorkerState& state) {
+    if (format == OutputFormat::Info)
+        return scanFile(job, state);
+
+    GifFile::MappedFile file;
+    if (file.open(job.path.c_str())) {
+        fprintf(stderr, "%s: could not open the file\n", job.path.c_str());
+        return 1;
+    }
+    GifDecode::Decoder& decoder = state.decoder;
+    if (decoder.open(file.data(), file.size())) {
+        fprintf(stderr, "%s: not a readable GIF file\n", job.path.c_str());
+        return 1;
+    }
+
+    // output names start with the position of the file in the input, so files with the same name do not collide
+    char prefix[32];
+    snprintf(prefix, sizeof(prefix), "%06lu_", (unsigned long)index);
+    std::string name = prefix + std::filesystem::path(job.path).stem().string();
+
+    size_t width = decoder.width(), height = decoder.height();
+    std::vector<uint8_t>& rgba = state.rgba;
+    rgba.resize(width * height * 4);
+    uint64_t checksum = 14695981039346656037ULL;
+    for (size_t i = 0; i < decoder.frameCount(); i++) {
+        if (decoder.decodeFrame(i, rgba.data(), width * 4)) {
+            fprintf(stderr, "%s: frame %lu could not be decoded\n", job.path.c_str(), (unsigned long)i);
+            return 1;
+        }
+        if (format == OutputFormat::Checksum) {
+            checksum = fnv1a(checksum, rgba.data(), rgba.size());
+        } else if (writeFrame(outDir, name, i, format, rgba.data(), width, height, state.rgb)) {
+            fprintf(stderr, "%s: could not write frame %lu to %s\n", job.path.c_str(), (unsigned long)i, outDir.c_str());
+            return 1;
+        }
+    }
+    job.frames = decoder.frameCount();
+    job.checksum = checksum;
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    OutputFormat format = OutputFormat::Checksum;
+    std::string outDir = ".";
+    unsigned threadCount = 0;
+    std::vector<FileJob> jobs;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rgba") == 0)
+                format = OutputFormat::Rgba;
+            else if (strcmp(argv[i], "ppm") == 0)
+                format = OutputFormat::Ppm;
+            else if (strcmp(argv[i], "checksum") == 0)
+                format = OutputFormat::Checksum;
+            else if (strcmp(argv[i], "info") == 0)
+                format = OutputFormat::Info;
+            else {
+                printf("Unrecognised format '%s'\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            outDir = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threadCount = strtoul(argv[++i], NULL, 10);
+        } else if (std::error_code error; std::filesystem::is_directory(argv[i], error)) {
+            std::vector<std::string> found;
+            findGifFiles(argv[i], found);
+            std::sort(found.begin(), found.end());
+            for (auto& path : found)
+                jobs.push_back(FileJob{path});
+        } else {
+            jobs.push_back(FileJob{argv[i]});
+        }
+    }
+
+    if (jobs.empty()) {
+        printf("Syntax: batch [--format checksum|rgba|ppm|info] [--out <directory>] [--threads <count, 0 = all cores>] <directories or GIF files...>\n");
+        return EXIT_FAILURE;
+    }
+    if (format == OutputFormat::Rgba || format == OutputFormat::Ppm) {
+        std::error_code error;
+        std::filesystem::create_directories(outDir, error);
+    }
+    if (threadCount == 0)
+        threadCount = std::max(1U, std::thread::hardware_concurrency());
+    threadCount = std::min<size_t>(threadCount, jobs.size());
+
+    WorkStealingPool pool(threadCount);
+    for (size_t i = 0; i < jobs.size(); i++) {
+        pool.push(i % threadCount, i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto worker = [&](size_t id) {
+        WorkerState state;
+        size_t job;
+        while (pool.take(id, job)) {
+            // one broken file must not stop the batch
+            try {
+                jobs[job].failed = transcodeFile(jobs[job], job, format, outDir, state);
+            } catch (const std::exception& e) {
+                fprintf(stderr, "%s: %s\n", jobs[job].path.c_str(), e.what());
+                jobs[job].failed = true;
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t t = 1; t < threadCount; t++) {
+        workers.emplace_back(worker, t);
+    }
+    worker(0);
+    for (auto& thread : workers) {
+        thread.join();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t failedFiles = 0, frames = 0;
+    for (auto& job : jobs) {
+        if (job.failed) {
+            failedFiles++;
+            continue;
+        }
+        frames += job.frames;
+        if (format == OutputFormat::Checksum)
+            printf("%016llx %lu %s\n", (unsigned long long)job.checksum, (unsigned long)job.frames, job.path.c_str());
+        else if (format == OutputFormat::Info)
+            printf("%lux%lu %lu frames %llu ms %s\n", (unsigned long)job.width, (unsigned long)job.height, (unsigned long)job.frames,
+                   (unsigned long long)job.duration, job.path.c_str());
+    }
+    printf("%lu files (%lu failed), %lu frames in %.3f s on %u threads: %.1f files/s, %.1f frames/s\n",
+           (unsigned long)jobs.size(), (unsigned long)failedFiles, (unsigned long)frames, seconds, threadCount,
+           (jobs.size() - failedFiles) / seconds, frames / seconds);
+    return failedFiles == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
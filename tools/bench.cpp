@@ -0,0 +1,251 @@
+/*
+ * Headless benchmark. Times every stage of the player separately over a set of GIF files:
+ *   parse     - GifFileReader::scanFile() walking the container (no LZW decoding)
+ *   decode    - LzwDecoder::decode() for every frame, through GifFileReader::decodeIndices()
+ *   composite - drawing every decoded frame into an offscreen canvas
+ *   composite_<n>x - the same, into a canvas magnified n times (--scales, 2x, 3x and 4x by default)
+ * and prints the results as JSON. Built and run by "python build.py bench [directories or files...]".
+ */
+#include "../src/gif.h"
+#include "../src/render.h"
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <filesystem>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+
+// peak resident set size of the process so far, in KiB
+static size_t peakRssKb() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+// quotes s for JSON. Paths are the only strings that are printed
+static std::string jsonString(const std::string& s) {
+    std::string quoted = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            quoted += '\\';
+        if ((unsigned char)c >= 0x20)
+            quoted += c;
+    }
+    return quoted + "\"";
+}
+
+static double msSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// timings of one stage over all iterations
+struct StageTimes {
+    std::vector<double> ms;
+
+    /* prints the stage as a JSON object. bytes and frames are the amount of work done per iteration,
+       and pixels (if not 0) the canvas pixels it produced */
+    void print(FILE* out, const char* name, size_t bytes, size_t frames, size_t pixels = 0) const {
+        double mean = 0, variance = 0;
+        for (double t : ms)
+            mean += t;
+        mean /= ms.size();
+        for (double t : ms)
+            variance += (t - mean) * (t - mean);
+        if (ms.size() > 1)
+            variance /= ms.size() - 1;
+
+        double seconds = mean / 1000.0;
+        fprintf(out, "\"%s\": {\"mean_ms\": %.4f, \"min_ms\": %.4f, \"max_ms\": %.4f, \"stddev_ms\": %.4f, \"variance_ms2\": %.6f, "
+                     "\"mb_per_s\": %.2f, \"frames_per_s\": %.1f",
+                name, mean, *std::min_element(ms.begin(), ms.end()), *std::max_element(ms.begin(), ms.end()),
+                std::sqrt(variance), variance,
+                seconds > 0 ? bytes / seconds / 1e6 : 0.0, seconds > 0 ? frames / seconds : 0.0);
+        if (pixels)
+            fprintf(out, ", \"mpixels_per_s\": %.1f}", seconds > 0 ? pixels / seconds / 1e6 : 0.0);
+        else
+            fprintf(out, "}");
+    }
+};
+
+struct FileResult {
+    std::string path;
+    bool failed = false;
+    size_t bytes = 0, frames = 0, width = 0, height = 0;
+    StageTimes parse, decode, composite;
+    std::vector<StageTimes> scaled; // one per scale factor
+    size_t peakRssKb = 0;
+};
+
+// true if path has the extension .gif, in any case
+static bool isGifPath(const std::filesystem::path& path) {
+    std::string extension = path.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return (char)tolower(c); });
+    return extension == ".gif";
+}
+
+// runs one iteration over path, compositing at every factor of scales as well. Returns: 0 on success, 1 on failure
+static bool runIteration(FileResult& result, const std::vector<size_t>& scales, bool record) {
+    auto start = std::chrono::steady_clock::now();
+    GifFile::GifFileReader reader(result.path.c_str());
+    if (reader.scanFile() != 0) // the frames are decoded below
+        return 1;
+    double parseMs = msSince(start);
+
+    // buffers are allocated before the clock starts so only the decoder is measured
+    std::vector<std::vector<uint8_t>> indices(reader.frames.size());
+    for (size_t i = 0; i < reader.frames.size(); i++)
+        indices[i].resize((size_t)reader.frames[i].width * reader.frames[i].height);
+
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reader.frames.size(); i++)
+        reader.decodeIndices(reader.frames[i], indices[i].data());
+    double decodeMs = msSince(start);
+
+    size_t width = reader.gifHeader.scrWidth, height = reader.gifHeader.scrHeight;
+    std::vector<uint32_t> pixels(width * height);
+    GifRender::Canvas canvas(reader, pixels.data(), width, GifRender::PixelLayout{16, 8, 0, 0});
+    start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < reader.frames.size(); i++)
+        canvas.drawFrame(i, indices[i].data());
+    double compositeMs = msSince(start);
+
+    // the canvas is built (with its scaling tables) before the clock starts, like a window that was just resized
+    std::vector<double> scaledMs;
+    for (size_t scale : scales) {
+        pixels.resize(width * scale * height * scale);
+        GifRender::Canvas scaledCanvas(reader, pixels.data(), width * scale, GifRender::PixelLayout{16, 8, 0, 0}, width * scale, height * scale);
+        start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < reader.frames.size(); i++)
+            scaledCanvas.drawFrame(i, indices[i].data());
+        scaledMs.push_back(msSince(start));
+    }
+
+    if (record) {
+        result.frames = reader.frames.size();
+        result.width = width;
+        result.height = height;
+        result.parse.ms.push_back(parseMs);
+        result.decode.ms.push_back(decodeMs);
+        result.composite.ms.push_back(compositeMs);
+        result.scaled.resize(scales.size());
+        for (size_t s = 0; s < scales.size(); s++)
+            result.scaled[s].ms.push_back(scaledMs[s]);
+    }
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    size_t iterations = 10;
+    FILE* out = stdout;
+    std::vector<std::string> paths;
+    std::vector<size_t> scales = {2, 3, 4};
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iterations = std::max<size_t>(1, strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            out = fopen(argv[++i], "w");
+            if (out == NULL) {
+                printf("Could not open %s for writing!\n", argv[i]);
+                return EXIT_FAILURE;
+            }
+        } else if (strcmp(argv[i], "--scales") == 0 && i + 1 < argc) {
+            // comma separated factors, 0 or an empty list leaves the scaled stages out
+            scales.clear();
+            for (const char* p = argv[++i]; *p;) {
+                char* end;
+                size_t scale = strtoul(p, &end, 10);
+                if (scale > 0)
+                    scales.push_back(scale);
+                p = (*end == ',') ? end + 1 : end + (*end != 0);
+            }
+        } else if (std::error_code error; std::filesystem::is_directory(argv[i], error)) {
+            // a directory that cannot be read, or an entry of it, is reported and skipped instead of ending the benchmark
+            std::vector<std::string> found;
+            std::filesystem::directory_iterator entry(argv[i], error), end;
+            for (; !error && entry != end; entry.increment(error)) {
+                std::error_code typeError;
+                if (entry->is_regular_file(typeError) && isGifPath(entry->path()))
+                    found.push_back(entry->path().string());
+            }
+            if (error)
+                fprintf(stderr, "Could not read %s: %s\n", argv[i], error.message().c_str());
+            std::sort(found.begin(), found.end());
+            paths.insert(paths.end(), found.begin(), found.end());
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty()) {
+        printf("Syntax: bench [--iterations n] [--output file.json] [--scales 2,3,4] <directories or GIF files...>\n");
+        return EXIT_FAILURE;
+    }
+
+    std::vector<FileResult> results(paths.size());
+    for (size_t f = 0; f < paths.size(); f++) {
+        FileResult& result = results[f];
+        result.path = paths[f];
+        std::error_code error;
+        result.bytes = std::filesystem::file_size(result.path, error);
+
+        // the first run is not recorded, it only warms the page cache
+        try {
+            for (size_t i = 0; i <= iterations && !result.failed; i++)
+                result.failed = runIteration(result, scales, i > 0);
+        } catch (const std::exception& e) {
+            fprintf(stderr, "%s: %s\n", result.path.c_str(), e.what());
+            result.failed = true;
+        }
+        result.peakRssKb = peakRssKb();
+    }
+
+    fprintf(out, "{\n  \"iterations\": %zu,\n  \"files\": [\n", iterations);
+    for (size_t f = 0; f < results.size(); f++) {
+        const FileResult& result = results[f];
+        fprintf(out, "    {\"file\": %s, \"bytes\": %zu, ", jsonString(result.path).c_str(), result.bytes);
+        if (result.failed) {
+            fprintf(out, "\"failed\": true}");
+        } else {
+            fprintf(out, "\"frames\": %zu, \"width\": %zu, \"height\": %zu, \"peak_rss_kb\": %zu,\n     ",
+                    result.frames, result.width, result.height, result.peakRssKb);
+            result.parse.print(out, "parse", result.bytes, result.frames);
+            fprintf(out, ",\n     ");
+            result.decode.print(out, "decode", result.bytes, result.frames);
+            fprintf(out, ",\n     ");
+            // compositing throughput is counted in canvas bytes, as every frame leaves a whole canvas behind
+            size_t canvasPixels = result.frames * result.width * result.height;
+            result.composite.print(out, "composite", canvasPixels * sizeof(uint32_t), result.frames, canvasPixels);
+            for (size_t s = 0; s < scales.size(); s++) {
+                std::string name = "composite_" + std::to_string(scales[s]) + "x";
+                size_t scaledPixels = canvasPixels * scales[s] * scales[s];
+                fprintf(out, ",\n     ");
+                result.scaled[s].print(out, name.c_str(), scaledPixels * sizeof(uint32_t), result.frames, scaledPixels);
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "%s\n", f + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n  \"peak_rss_kb\": %zu\n}\n", peakRssKb());
+
+    if (out != stdout)
+        fclose(out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,88 @@
+/*
+ * Re-encodes a GIF file with GifOptimize::optimize(): frames are cropped to what changed, unchanged pixels become
+ * transparent and frames that change nothing are merged into the one before. With --verify both files are decoded
+ * again and every frame of the input is compared with the output frame that shows it.
+ * Built by "python build.py optimize".
+ */
+#include "../src/gifdecode.h"
+#include "../src/optimize.h"
+
+
+// compares the composited frames of both files. Returns: 0 if every frame matches, 1 otherwise
+static bool verify(const char* inputPath, const char* outputPath, const std::vector<size_t>& outputFrames) {
+    GifFile::MappedFile inputFile, outputFile;
+    GifDecode::Decoder input, output;
+    if (inputFile.open(inputPath) || outputFile.open(outputPath) ||
+        input.open(inputFile.data(), inputFile.size()) || output.open(outputFile.data(), outputFile.size())) {
+        printf("Could not read the files back!\n");
+        return 1;
+    }
+    if (input.width() != output.width() || input.height() != output.height()) {
+        printf("The output is %lix%li instead of %lix%li!\n", (long)output.width(), (long)output.height(), (long)input.width(), (long)input.height());
+        return 1;
+    }
+
+    std::vector<uint8_t> expected(input.width() * input.height() * 4), actual(expected.size());
+    uint64_t inputDuration = 0, outputDuration = 0;
+    for (size_t i = 0; i < input.frameCount(); i++) {
+        if (input.decodeFrame(i, expected.data(), input.width() * 4) || output.decodeFrame(outputFrames[i], actual.data(), output.width() * 4)) {
+            printf("Frame %li could not be decoded!\n", (long)i);
+            return 1;
+        }
+        if (expected != actual) {
+            printf("Frame %li differs from output frame %li!\n", (long)i, (long)outputFrames[i]);
+            return 1;
+        }
+        GifDecode::FrameInfo info;
+        input.frameInfo(i, info);
+        inputDuration += info.delayTime;
+    }
+    for (size_t i = 0; i < output.frameCount(); i++) {
+        GifDecode::FrameInfo info;
+        output.frameInfo(i, info);
+        outputDuration += info.delayTime;
+    }
+    if (inputDuration != outputDuration) {
+        printf("The output plays for %llu ms instead of %llu ms!\n", (unsigned long long)outputDuration, (unsigned long long)inputDuration);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, const char* argv[]) {
+    bool verifyOutput = false;
+    std::vector<const char*> paths;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--verify") == 0)
+            verifyOutput = true;
+        else
+            paths.push_back(argv[i]);
+    }
+    if (paths.size() != 2) {
+        printf("Syntax: optimize [--verify] <input GIF file> <output GIF file>\n");
+        return EXIT_FAILURE;
+    }
+
+    // only the structure is read, optimize() decodes one frame at a time
+    GifFile::GifFileReader reader(paths[0]);
+    if (reader.scanFile())
+        return EXIT_FAILURE;
+
+    GifFile::GifFileWriter writer;
+    std::vector<size_t> outputFrames;
+    if (GifOptimize::optimize(reader, writer, &outputFrames) || writer.saveFile(paths[1]))
+        return EXIT_FAILURE;
+
+    GifFile::MappedFile inputFile;
+    size_t inputSize = inputFile.open(paths[0]) ? 0 : inputFile.size();
+    size_t outputCount = outputFrames.empty() ? 0 : outputFrames.back() + 1;
+    printf("%s: %li frames, %li bytes -> %s: %li frames, %li bytes (%.1f%%)\n", paths[0], (long)reader.frames.size(), (long)inputSize,
+           paths[1], (long)outputCount, (long)writer.data().size(), inputSize ? 100.0 * writer.data().size() / inputSize : 100.0);
+
+    if (verifyOutput) {
+        if (verify(paths[0], paths[1], outputFrames))
+            return EXIT_FAILURE;
+        printf("Every frame matches.\n");
+    }
+    return EXIT_SUCCESS;
+}